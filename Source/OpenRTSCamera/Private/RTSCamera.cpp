@@ -10,6 +10,8 @@
 #include "EnhancedInputSubsystems.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "RTSCameraBoundsVolume.h"
+#include "RTSGroundHeightfield.h"
 #include "Runtime/CoreUObject/Public/UObject/ConstructorHelpers.h"
 
 URTSCamera::URTSCamera()
@@ -25,6 +27,11 @@ URTSCamera::URTSCamera()
 	this->EnableDynamicCameraHeight = true;
 	this->EnableEdgeScrolling = true;
 	this->FindGroundTraceLength = 100000;
+	this->GroundHeightSampleSpacing = 200;
+	this->GroundHeightCacheMaxTiles = 64;
+	this->GroundHeightfield = nullptr;
+	this->EnableAsyncGroundTraces = false;
+	this->GroundHeightCatchupSpeed = 8;
 	this->MaximumZoomLength = 5000;
 	this->MinimumZoomLength = 500;
 	this->MoveSpeed = 50;
@@ -86,12 +93,14 @@ void URTSCamera::TickComponent(
 	if (NetMode != NM_DedicatedServer && this->PlayerController->GetViewTarget() == this->Owner)
 	{
 		this->DeltaSeconds = DeltaTime;
+		this->BeginRootTransformUpdate();
 		this->ApplyMoveCameraCommands();
 		this->ConditionallyPerformEdgeScrolling();
 		this->ConditionallyKeepCameraAtDesiredZoomAboveGround();
 		this->SmoothTargetArmLengthToDesiredZoom();
 		this->FollowTargetIfSet();
 		this->ConditionallyApplyCameraBounds();
+		this->CommitRootTransformUpdate();
 	}
 }
 
@@ -116,44 +125,17 @@ void URTSCamera::OnZoomCamera(const FInputActionValue& Value)
 
 void URTSCamera::OnRotateCamera(const FInputActionValue& Value)
 {
-	const auto WorldRotation = this->Root->GetComponentRotation();
-	this->Root->SetWorldRotation(
-		FRotator::MakeFromEuler(
-			FVector(
-				WorldRotation.Euler().X,
-				WorldRotation.Euler().Y,
-				WorldRotation.Euler().Z + Value.Get<float>()
-			)
-		)
-	);
+	this->PendingRootYaw += Value.Get<float>();
 }
 
 void URTSCamera::OnTurnCameraLeft(const FInputActionValue&)
 {
-	const auto WorldRotation = this->Root->GetRelativeRotation();
-	this->Root->SetRelativeRotation(
-		FRotator::MakeFromEuler(
-			FVector(
-				WorldRotation.Euler().X,
-				WorldRotation.Euler().Y,
-				WorldRotation.Euler().Z - this->RotateSpeed
-			)
-		)
-	);
+	this->PendingRootYaw -= this->RotateSpeed;
 }
 
 void URTSCamera::OnTurnCameraRight(const FInputActionValue&)
 {
-	const auto WorldRotation = this->Root->GetRelativeRotation();
-	this->Root->SetRelativeRotation(
-		FRotator::MakeFromEuler(
-			FVector(
-				WorldRotation.Euler().X,
-				WorldRotation.Euler().Y,
-				WorldRotation.Euler().Z + this->RotateSpeed
-			)
-		)
-	);
+	this->PendingRootYaw += this->RotateSpeed;
 }
 
 void URTSCamera::OnMoveCameraYAxis(const FInputActionValue& Value)
@@ -213,26 +195,34 @@ void URTSCamera::OnDragCamera(const FInputActionValue& Value)
 
 void URTSCamera::RequestMoveCamera(const float X, const float Y, const float Scale)
 {
-	FMoveCameraCommand MoveCameraCommand;
-	MoveCameraCommand.X = X;
-	MoveCameraCommand.Y = Y;
-	MoveCameraCommand.Scale = Scale;
-	MoveCameraCommands.Push(MoveCameraCommand);
+	this->MoveCameraCommands.Add(X, Y, Scale);
 }
 
 void URTSCamera::ApplyMoveCameraCommands()
 {
-	for (const auto& [X, Y, Scale] : this->MoveCameraCommands)
+	const auto Movement = this->MoveCameraCommands.Consume() * this->MoveSpeed * this->DeltaSeconds;
+	this->DesiredRootLocation += FVector(Movement.X, Movement.Y, 0.0f);
+}
+
+/**
+ * Every step of the tick moves the desired root transform, which is only applied to the root once at the end so its
+ * children, the spring arm and camera, are only updated once however many inputs came in
+ */
+void URTSCamera::BeginRootTransformUpdate()
+{
+	this->DesiredRootLocation = this->Root->GetComponentLocation();
+	this->DesiredRootRotation = this->Root->GetComponentRotation();
+	this->DesiredRootRotation.Yaw += this->PendingRootYaw;
+	this->PendingRootYaw = 0;
+}
+
+void URTSCamera::CommitRootTransformUpdate() const
+{
+	if (this->DesiredRootLocation != this->Root->GetComponentLocation()
+		|| this->DesiredRootRotation != this->Root->GetComponentRotation())
 	{
-		auto Movement = FVector2D(X, Y);
-		Movement.Normalize();
-		Movement *= this->MoveSpeed * Scale * this->DeltaSeconds;
-		this->Root->SetWorldLocation(
-			this->Root->GetComponentLocation() + FVector(Movement.X, Movement.Y, 0.0f)
-		);
+		this->Root->SetWorldLocationAndRotation(this->DesiredRootLocation, this->DesiredRootRotation);
 	}
-
-	this->MoveCameraCommands.Empty();
 }
 
 void URTSCamera::CollectComponentDependencyReferences()
@@ -275,6 +265,12 @@ void URTSCamera::TryToFindBoundaryVolumeReference()
 	if (BlockingVolumes.Num() > 0)
 	{
 		this->BoundaryVolume = BlockingVolumes[0];
+
+		const auto* BoundsVolume = Cast<ARTSCameraBoundsVolume>(this->BoundaryVolume);
+		if (this->GroundHeightfield == nullptr && BoundsVolume != nullptr)
+		{
+			this->GroundHeightfield = BoundsVolume->GroundHeightfield;
+		}
 	}
 }
 
@@ -399,7 +395,93 @@ void URTSCamera::JumpTo(const FVector Position) const
 	this->Root->SetWorldLocation(Position);
 }
 
-void URTSCamera::ConditionallyPerformEdgeScrolling() const
+void URTSCamera::RegisterGroundHeightActor(AActor* Actor)
+{
+	if (Actor == nullptr || Actor->GetRootComponent() == nullptr)
+	{
+		return;
+	}
+
+	for (const auto& GroundHeightActor : this->GroundHeightActors)
+	{
+		if (GroundHeightActor.Actor == Actor)
+		{
+			return;
+		}
+	}
+
+	FGroundHeightActor GroundHeightActor;
+	GroundHeightActor.Actor = Actor;
+	GroundHeightActor.Bounds = Actor->GetComponentsBoundingBox(true);
+	GroundHeightActor.TransformUpdatedHandle = Actor->GetRootComponent()->TransformUpdated.AddUObject(
+		this,
+		&URTSCamera::OnGroundHeightActorTransformUpdated
+	);
+	Actor->OnDestroyed.AddDynamic(this, &URTSCamera::OnGroundHeightActorDestroyed);
+
+	this->GroundHeightCache.Invalidate(GroundHeightActor.Bounds);
+	this->GroundHeightActors.Add(GroundHeightActor);
+}
+
+void URTSCamera::UnregisterGroundHeightActor(AActor* Actor)
+{
+	for (int32 Index = 0; Index < this->GroundHeightActors.Num(); Index++)
+	{
+		const auto& GroundHeightActor = this->GroundHeightActors[Index];
+		if (GroundHeightActor.Actor != Actor)
+		{
+			continue;
+		}
+
+		// The ground under it is changing either way, whether it's destroyed or just no longer tracked
+		this->GroundHeightCache.Invalidate(GroundHeightActor.Bounds);
+
+		if (Actor)
+		{
+			if (USceneComponent* ActorRoot = Actor->GetRootComponent())
+			{
+				ActorRoot->TransformUpdated.Remove(GroundHeightActor.TransformUpdatedHandle);
+			}
+			Actor->OnDestroyed.RemoveDynamic(this, &URTSCamera::OnGroundHeightActorDestroyed);
+		}
+
+		this->GroundHeightActors.RemoveAtSwap(Index);
+		return;
+	}
+}
+
+void URTSCamera::InvalidateGroundHeightCache()
+{
+	this->GroundHeightCache.Reset();
+	this->IsAsyncGroundTraceStale = true;
+}
+
+void URTSCamera::OnGroundHeightActorTransformUpdated(
+	USceneComponent* UpdatedComponent,
+	EUpdateTransformFlags UpdateTransformFlags,
+	ETeleportType Teleport
+)
+{
+	const AActor* Actor = UpdatedComponent->GetOwner();
+	for (auto& GroundHeightActor : this->GroundHeightActors)
+	{
+		if (GroundHeightActor.Actor == Actor)
+		{
+			// Both where it was and where it is now have different ground
+			this->GroundHeightCache.Invalidate(GroundHeightActor.Bounds);
+			GroundHeightActor.Bounds = Actor->GetComponentsBoundingBox(true);
+			this->GroundHeightCache.Invalidate(GroundHeightActor.Bounds);
+			return;
+		}
+	}
+}
+
+void URTSCamera::OnGroundHeightActorDestroyed(AActor* DestroyedActor)
+{
+	this->UnregisterGroundHeightActor(DestroyedActor);
+}
+
+void URTSCamera::ConditionallyPerformEdgeScrolling()
 {
 	if (this->EnableEdgeScrolling && !this->IsDragging)
 	{
@@ -410,7 +492,7 @@ void URTSCamera::ConditionallyPerformEdgeScrolling() const
 	}
 }
 
-void URTSCamera::EdgeScrollLeft() const
+void URTSCamera::EdgeScrollLeft()
 {
 	const auto MousePosition = UWidgetLayoutLibrary::GetMousePositionOnViewport(this->GetWorld());
 	const auto ViewportSize = UWidgetLayoutLibrary::GetViewportWidgetGeometry(this->GetWorld()).GetLocalSize();
@@ -422,12 +504,11 @@ void URTSCamera::EdgeScrollLeft() const
 
 	const auto Movement = UKismetMathLibrary::FClamp(NormalizedMousePosition, 0.0, 1.0);
 
-	this->Root->AddRelativeLocation(
-		-1 * this->Root->GetRightVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds
-	);
+	this->DesiredRootLocation +=
+		-1 * this->DesiredRootRotation.Quaternion().GetRightVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds;
 }
 
-void URTSCamera::EdgeScrollRight() const
+void URTSCamera::EdgeScrollRight()
 {
 	const auto MousePosition = UWidgetLayoutLibrary::GetMousePositionOnViewport(this->GetWorld());
 	const auto ViewportSize = UWidgetLayoutLibrary::GetViewportWidgetGeometry(this->GetWorld()).GetLocalSize();
@@ -438,12 +519,11 @@ void URTSCamera::EdgeScrollRight() const
 	);
 
 	const auto Movement = UKismetMathLibrary::FClamp(NormalizedMousePosition, 0.0, 1.0);
-	this->Root->AddRelativeLocation(
-		this->Root->GetRightVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds
-	);
+	this->DesiredRootLocation +=
+		this->DesiredRootRotation.Quaternion().GetRightVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds;
 }
 
-void URTSCamera::EdgeScrollUp() const
+void URTSCamera::EdgeScrollUp()
 {
 	const auto MousePosition = UWidgetLayoutLibrary::GetMousePositionOnViewport(this->GetWorld());
 	const auto ViewportSize = UWidgetLayoutLibrary::GetViewportWidgetGeometry(this->GetWorld()).GetLocalSize();
@@ -454,12 +534,11 @@ void URTSCamera::EdgeScrollUp() const
 	);
 
 	const auto Movement = 1 - UKismetMathLibrary::FClamp(NormalizedMousePosition, 0.0, 1.0);
-	this->Root->AddRelativeLocation(
-		this->Root->GetForwardVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds
-	);
+	this->DesiredRootLocation +=
+		this->DesiredRootRotation.Quaternion().GetForwardVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds;
 }
 
-void URTSCamera::EdgeScrollDown() const
+void URTSCamera::EdgeScrollDown()
 {
 	const auto MousePosition = UWidgetLayoutLibrary::GetMousePositionOnViewport(this->GetWorld());
 	const auto ViewportSize = UWidgetLayoutLibrary::GetViewportWidgetGeometry(this->GetWorld()).GetLocalSize();
@@ -470,16 +549,15 @@ void URTSCamera::EdgeScrollDown() const
 	);
 
 	const auto Movement = UKismetMathLibrary::FClamp(NormalizedMousePosition, 0.0, 1.0);
-	this->Root->AddRelativeLocation(
-		-1 * this->Root->GetForwardVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds
-	);
+	this->DesiredRootLocation +=
+		-1 * this->DesiredRootRotation.Quaternion().GetForwardVector() * Movement * this->EdgeScrollSpeed * this->DeltaSeconds;
 }
 
-void URTSCamera::FollowTargetIfSet() const
+void URTSCamera::FollowTargetIfSet()
 {
 	if (this->CameraFollowTarget != nullptr)
 	{
-		this->Root->SetWorldLocation(this->CameraFollowTarget->GetActorLocation());
+		this->DesiredRootLocation = this->CameraFollowTarget->GetActorLocation();
 	}
 }
 
@@ -497,33 +575,48 @@ void URTSCamera::ConditionallyKeepCameraAtDesiredZoomAboveGround()
 {
 	if (this->EnableDynamicCameraHeight)
 	{
-		const auto RootWorldLocation = this->Root->GetComponentLocation();
-		const TArray<AActor*> ActorsToIgnore;
+		const auto RootWorldLocation = this->DesiredRootLocation;
+		const auto RootGroundLocation = FVector2D(RootWorldLocation.X, RootWorldLocation.Y);
 
-		auto HitResult = FHitResult();
-		auto DidHit = UKismetSystemLibrary::LineTraceSingle(
-			this->GetWorld(),
-			FVector(RootWorldLocation.X, RootWorldLocation.Y, RootWorldLocation.Z + this->FindGroundTraceLength),
-			FVector(RootWorldLocation.X, RootWorldLocation.Y, RootWorldLocation.Z - this->FindGroundTraceLength),
-			UEngineTypes::ConvertToTraceType(this->CollisionChannel),
-			true,
-			ActorsToIgnore,
-			EDrawDebugTrace::Type::None,
-			HitResult,
-			true
-		);
+		auto GroundHeight = 0.0;
+		auto DidHit = this->CanUseGroundHeightfield(RootGroundLocation)
+			&& this->GroundHeightfield->GetHeight(RootGroundLocation, GroundHeight);
 
-		if (DidHit)
+		// Traces also cover holes in the heightfield, where the bake found no ground around the camera
+		if (!DidHit && this->EnableAsyncGroundTraces)
 		{
-			this->Root->SetWorldLocation(
-				FVector(
-					HitResult.Location.X,
-					HitResult.Location.Y,
-					HitResult.Location.Z
+			this->UpdateAsyncGroundTrace(RootGroundLocation);
+
+			// Stays put until the first trace lands
+			DidHit = !this->HasAsyncGroundTraceResult || this->AsyncGroundTraceHit;
+			GroundHeight = this->HasAsyncGroundTraceResult && this->AsyncGroundTraceHit
+				? FMath::FInterpTo(
+					RootWorldLocation.Z,
+					this->AsyncGroundHeight,
+					this->DeltaSeconds,
+					this->GroundHeightCatchupSpeed
 				)
+				: RootWorldLocation.Z;
+		} else if (!DidHit)
+		{
+			this->GroundHeightCache.Configure(this->GroundHeightSampleSpacing, this->GroundHeightCacheMaxTiles);
+
+			// Only traces for samples around the camera that haven't been taken yet
+			DidHit = this->GroundHeightCache.GetHeight(
+				RootGroundLocation,
+				[this](const FVector2D& Location, double& OutHeight)
+				{
+					return this->TraceGroundHeight(Location, OutHeight);
+				},
+				GroundHeight
 			);
 		}
 
+		if (DidHit)
+		{
+			this->DesiredRootLocation.Z = GroundHeight;
+		}
+
 		else if (!this->IsCameraOutOfBoundsErrorAlreadyDisplayed)
 		{
 			this->IsCameraOutOfBoundsErrorAlreadyDisplayed = true;
@@ -558,20 +651,133 @@ void URTSCamera::ConditionallyKeepCameraAtDesiredZoomAboveGround()
 	}
 }
 
-void URTSCamera::ConditionallyApplyCameraBounds() const
+/**
+ * Traces straight down through the whole height range for one ground height sample. The trace doesn't start from
+ * the camera so the sample is the same whatever height the camera was at when it was taken.
+ */
+bool URTSCamera::TraceGroundHeight(const FVector2D& Location, double& OutHeight) const
+{
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(RTSCameraGroundHeight), true, this->Owner);
+
+	auto HitResult = FHitResult();
+	const auto DidHit = this->GetWorld()->LineTraceSingleByChannel(
+		HitResult,
+		FVector(Location.X, Location.Y, this->FindGroundTraceLength),
+		FVector(Location.X, Location.Y, -this->FindGroundTraceLength),
+		this->CollisionChannel,
+		QueryParams
+	);
+
+	OutHeight = HitResult.Location.Z;
+	return DidHit;
+}
+
+/**
+ * Picks up the result of the trace issued on an earlier tick, then issues the next one where the root will be next
+ * tick if it keeps moving as it did this one. The ground under a still camera is only traced again once something
+ * may have changed it.
+ */
+void URTSCamera::UpdateAsyncGroundTrace(const FVector2D& RootGroundLocation)
+{
+	const auto World = this->GetWorld();
+
+	if (World->IsTraceHandleValid(this->AsyncGroundTraceHandle, false))
+	{
+		FTraceDatum TraceDatum;
+		if (World->QueryTraceData(this->AsyncGroundTraceHandle, TraceDatum))
+		{
+			this->AsyncGroundTraceHit = TraceDatum.OutHits.Num() > 0 && TraceDatum.OutHits[0].bBlockingHit;
+			if (this->AsyncGroundTraceHit)
+			{
+				this->AsyncGroundHeight = TraceDatum.OutHits[0].Location.Z;
+			}
+			this->HasAsyncGroundTraceResult = true;
+			this->AsyncGroundTraceHandle = FTraceHandle();
+		}
+	} else
+	{
+		// Dropped without a result, e.g. by a level transition
+		this->AsyncGroundTraceHandle = FTraceHandle();
+	}
+
+	const auto PredictedLocation = this->HasLastRootGroundLocation
+		? RootGroundLocation * 2.0 - this->LastRootGroundLocation
+		: RootGroundLocation;
+	this->LastRootGroundLocation = RootGroundLocation;
+	this->HasLastRootGroundLocation = true;
+
+	const auto IsGroundUnchanged = !this->IsAsyncGroundTraceStale
+		&& this->GroundHeightActors.Num() == 0
+		&& PredictedLocation == this->AsyncGroundTraceLocation;
+	if (this->AsyncGroundTraceHandle.IsValid() || IsGroundUnchanged)
+	{
+		return;
+	}
+
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(RTSCameraAsyncGroundHeight), true, this->Owner);
+	this->AsyncGroundTraceHandle = World->AsyncLineTraceByChannel(
+		EAsyncTraceType::Single,
+		FVector(PredictedLocation.X, PredictedLocation.Y, this->FindGroundTraceLength),
+		FVector(PredictedLocation.X, PredictedLocation.Y, -this->FindGroundTraceLength),
+		this->CollisionChannel,
+		QueryParams
+	);
+	this->AsyncGroundTraceLocation = PredictedLocation;
+	this->IsAsyncGroundTraceStale = false;
+}
+
+/**
+ * The heightfield only knows the ground it was baked with, so it isn't used near registered ground height actors
+ * which can move or have been placed since, unless its height range shows they're buried under the baked ground
+ */
+bool URTSCamera::CanUseGroundHeightfield(const FVector2D& Location) const
+{
+	if (this->GroundHeightfield == nullptr || !this->GroundHeightfield->Contains(Location))
+	{
+		return false;
+	}
+
+	for (const auto& GroundHeightActor : this->GroundHeightActors)
+	{
+		// Widened by a sample, as the cached heights there are filtered with samples that far away
+		const auto Bounds = FBox2D(
+			FVector2D(GroundHeightActor.Bounds.Min) - this->GroundHeightSampleSpacing,
+			FVector2D(GroundHeightActor.Bounds.Max) + this->GroundHeightSampleSpacing
+		);
+		if (!GroundHeightActor.Bounds.IsValid || !Bounds.IsInside(Location))
+		{
+			continue;
+		}
+
+		// Traces down would hit the baked ground before an actor sunk entirely below it
+		auto LowestGroundHeight = 0.0;
+		auto HighestGroundHeight = 0.0;
+		const auto IsBelowGround = this->GroundHeightfield->GetHeightRange(
+			FBox2D(FVector2D(GroundHeightActor.Bounds.Min), FVector2D(GroundHeightActor.Bounds.Max)),
+			LowestGroundHeight,
+			HighestGroundHeight
+		) && GroundHeightActor.Bounds.Max.Z < LowestGroundHeight;
+		if (!IsBelowGround)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void URTSCamera::ConditionallyApplyCameraBounds()
 {
 	if (this->BoundaryVolume != nullptr)
 	{
-		const auto RootWorldLocation = this->Root->GetComponentLocation();
+		const auto RootWorldLocation = this->DesiredRootLocation;
 		FVector Origin;
 		FVector Extents;
 		this->BoundaryVolume->GetActorBounds(false, Origin, Extents);
-		this->Root->SetWorldLocation(
-			FVector(
-				UKismetMathLibrary::Clamp(RootWorldLocation.X, Origin.X - Extents.X, Origin.X + Extents.X),
-				UKismetMathLibrary::Clamp(RootWorldLocation.Y, Origin.Y - Extents.Y, Origin.Y + Extents.Y),
-				RootWorldLocation.Z
-			)
+		this->DesiredRootLocation = FVector(
+			UKismetMathLibrary::Clamp(RootWorldLocation.X, Origin.X - Extents.X, Origin.X + Extents.X),
+			UKismetMathLibrary::Clamp(RootWorldLocation.Y, Origin.Y - Extents.Y, Origin.Y + Extents.Y),
+			RootWorldLocation.Z
 		);
 	}
 }
@@ -2,13 +2,44 @@
 
 #include "RTSCameraBoundsVolume.h"
 #include "Components/PrimitiveComponent.h"
+#include "RTSGroundHeightfield.h"
 
 ARTSCameraBoundsVolume::ARTSCameraBoundsVolume()
 {
     this->Tags.Add("OpenRTSCamera#CameraBounds");
+    this->GroundHeightfieldSampleSpacing = 200;
+    this->GroundHeightfieldCollisionChannel = ECC_WorldStatic;
+    this->GroundHeightfieldTraceLength = 100000;
     
     if (UPrimitiveComponent* PrimitiveComponent = this->FindComponentByClass<UPrimitiveComponent>())
     {
         PrimitiveComponent->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName, false);
     }
 }
+
+#if WITH_EDITOR
+void ARTSCameraBoundsVolume::BakeGroundHeightfield()
+{
+    if (this->GroundHeightfield == nullptr)
+    {
+        UE_LOG(LogTemp, Error, TEXT("%s has no Ground Heightfield asset to bake into"), *this->GetName());
+        return;
+    }
+
+    FVector Origin;
+    FVector Extents;
+    this->GetActorBounds(false, Origin, Extents);
+
+    this->GroundHeightfield->Modify();
+    if (!this->GroundHeightfield->Bake(
+        this->GetWorld(),
+        FBox(Origin - Extents, Origin + Extents),
+        this->GroundHeightfieldSampleSpacing,
+        this->GroundHeightfieldTraceLength,
+        this->GroundHeightfieldCollisionChannel
+    ))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("%s found no ground to bake into %s"), *this->GetName(), *this->GroundHeightfield->GetName());
+    }
+}
+#endif
@@ -0,0 +1,198 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSGroundHeightCache.h"
+
+// Rounds towards negative infinity, so samples left of or below the origin land in the right tile
+static int32 FloorDivide(const int32 Dividend, const int32 Divisor)
+{
+	return Dividend >= 0 ? Dividend / Divisor : (Dividend - Divisor + 1) / Divisor;
+}
+
+void FRTSGroundHeightCache::Configure(const float InSampleSpacing, const int32 InMaxTiles)
+{
+	const float NewSampleSpacing = FMath::Max(InSampleSpacing, 1.0f);
+	if (NewSampleSpacing != SampleSpacing)
+	{
+		Reset();
+		SampleSpacing = NewSampleSpacing;
+	}
+
+	// A lookup can touch four tiles, none of which may be evicted by another
+	MaxTiles = FMath::Max(InMaxTiles, 4);
+	while (Tiles.Num() > MaxTiles)
+	{
+		EvictLeastRecentlyUsedTile();
+	}
+}
+
+bool FRTSGroundHeightCache::GetHeight(const FVector2D& Location, const FSampleFunction SampleHeight, double& OutHeight)
+{
+	check(SampleSpacing > 0.0f);
+
+	const FVector2D GridLocation = Location / SampleSpacing;
+	const FIntPoint BaseSample(FMath::FloorToInt(GridLocation.X), FMath::FloorToInt(GridLocation.Y));
+	const FVector2D Alpha = GridLocation - FVector2D(BaseSample);
+
+	UseCounter++;
+
+	double WeightedHeight = 0.0;
+	double TotalWeight = 0.0;
+	for (int32 Corner = 0; Corner < 4; Corner++)
+	{
+		const FIntPoint Sample = BaseSample + FIntPoint(Corner & 1, Corner >> 1);
+		const FIntPoint TileCoordinates(FloorDivide(Sample.X, TileSize), FloorDivide(Sample.Y, TileSize));
+		const int32 SampleIndex = (Sample.Y - TileCoordinates.Y * TileSize) * TileSize + (Sample.X - TileCoordinates.X * TileSize);
+		const uint64 SampleBit = uint64(1) << SampleIndex;
+
+		// Not kept across corners, adding a tile can move the others
+		FTile& Tile = FindOrAddTile(TileCoordinates);
+		if ((Tile.SampledMask & SampleBit) == 0)
+		{
+			double Height = 0.0;
+			if (SampleHeight(FVector2D(Sample) * SampleSpacing, Height))
+			{
+				Tile.Heights[SampleIndex] = Height;
+				Tile.GroundMask |= SampleBit;
+			} else
+			{
+				Tile.GroundMask &= ~SampleBit;
+			}
+			Tile.SampledMask |= SampleBit;
+		}
+
+		if (Tile.GroundMask & SampleBit)
+		{
+			// Never quite zero, so ground exactly on a sample still counts when its neighbours have none
+			const double Weight = FMath::Max(
+				((Corner & 1) ? Alpha.X : 1.0 - Alpha.X) * ((Corner >> 1) ? Alpha.Y : 1.0 - Alpha.Y),
+				UE_KINDA_SMALL_NUMBER
+			);
+			WeightedHeight += Tile.Heights[SampleIndex] * Weight;
+			TotalWeight += Weight;
+		}
+	}
+
+	if (TotalWeight <= 0.0)
+	{
+		return false;
+	}
+
+	OutHeight = WeightedHeight / TotalWeight;
+	return true;
+}
+
+/**
+ * Clears the samples inside the box from whichever tiles are cached
+ * @param Box World space, only its XY matters
+ */
+void FRTSGroundHeightCache::Invalidate(const FBox& Box)
+{
+	if (!Box.IsValid || SampleSpacing <= 0.0f || Tiles.Num() == 0)
+	{
+		return;
+	}
+
+	const FIntPoint MinSample(
+		FMath::CeilToInt(Box.Min.X / SampleSpacing),
+		FMath::CeilToInt(Box.Min.Y / SampleSpacing)
+	);
+	const FIntPoint MaxSample(
+		FMath::FloorToInt(Box.Max.X / SampleSpacing),
+		FMath::FloorToInt(Box.Max.Y / SampleSpacing)
+	);
+	if (MinSample.X > MaxSample.X || MinSample.Y > MaxSample.Y)
+	{
+		return;
+	}
+
+	const FIntPoint MinTile(FloorDivide(MinSample.X, TileSize), FloorDivide(MinSample.Y, TileSize));
+	const FIntPoint MaxTile(FloorDivide(MaxSample.X, TileSize), FloorDivide(MaxSample.Y, TileSize));
+
+	const auto InvalidateTile = [&MinSample, &MaxSample](const FIntPoint& TileCoordinates, FTile& Tile)
+	{
+		const FIntPoint TileOrigin = TileCoordinates * TileSize;
+		const int32 MinX = FMath::Max(MinSample.X - TileOrigin.X, 0);
+		const int32 MaxX = FMath::Min(MaxSample.X - TileOrigin.X, TileSize - 1);
+		const int32 MinY = FMath::Max(MinSample.Y - TileOrigin.Y, 0);
+		const int32 MaxY = FMath::Min(MaxSample.Y - TileOrigin.Y, TileSize - 1);
+
+		for (int32 Y = MinY; Y <= MaxY; Y++)
+		{
+			for (int32 X = MinX; X <= MaxX; X++)
+			{
+				Tile.SampledMask &= ~(uint64(1) << (Y * TileSize + X));
+			}
+		}
+	};
+
+	// A large box covers far more tiles than are cached, walk whichever is smaller
+	const int64 TilesInRange = int64(MaxTile.X - MinTile.X + 1) * int64(MaxTile.Y - MinTile.Y + 1);
+	if (TilesInRange > Tiles.Num())
+	{
+		for (auto& [TileCoordinates, Tile] : Tiles)
+		{
+			if (TileCoordinates.X >= MinTile.X && TileCoordinates.X <= MaxTile.X
+				&& TileCoordinates.Y >= MinTile.Y && TileCoordinates.Y <= MaxTile.Y)
+			{
+				InvalidateTile(TileCoordinates, Tile);
+			}
+		}
+		return;
+	}
+
+	for (int32 TileY = MinTile.Y; TileY <= MaxTile.Y; TileY++)
+	{
+		for (int32 TileX = MinTile.X; TileX <= MaxTile.X; TileX++)
+		{
+			const FIntPoint TileCoordinates(TileX, TileY);
+			if (FTile* Tile = Tiles.Find(TileCoordinates))
+			{
+				InvalidateTile(TileCoordinates, *Tile);
+			}
+		}
+	}
+}
+
+void FRTSGroundHeightCache::Reset()
+{
+	Tiles.Reset();
+	UseCounter = 0;
+}
+
+FRTSGroundHeightCache::FTile& FRTSGroundHeightCache::FindOrAddTile(const FIntPoint& TileCoordinates)
+{
+	if (FTile* Tile = Tiles.Find(TileCoordinates))
+	{
+		Tile->LastUsed = UseCounter;
+		return *Tile;
+	}
+
+	if (Tiles.Num() >= MaxTiles)
+	{
+		EvictLeastRecentlyUsedTile();
+	}
+
+	FTile& Tile = Tiles.Add(TileCoordinates);
+	Tile.LastUsed = UseCounter;
+	return Tile;
+}
+
+// Only runs when a tile is added to a full cache, which is small enough to scan
+void FRTSGroundHeightCache::EvictLeastRecentlyUsedTile()
+{
+	const FIntPoint* LeastRecentlyUsed = nullptr;
+	uint64 OldestUse = TNumericLimits<uint64>::Max();
+	for (const auto& [TileCoordinates, Tile] : Tiles)
+	{
+		if (Tile.LastUsed < OldestUse)
+		{
+			OldestUse = Tile.LastUsed;
+			LeastRecentlyUsed = &TileCoordinates;
+		}
+	}
+
+	if (LeastRecentlyUsed)
+	{
+		Tiles.Remove(FIntPoint(*LeastRecentlyUsed));
+	}
+}
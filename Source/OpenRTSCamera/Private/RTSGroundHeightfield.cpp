@@ -0,0 +1,312 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSGroundHeightfield.h"
+
+#include "Engine/World.h"
+
+// Keeps the largest bake around 32MB of heights, the spacing is widened to fit
+static constexpr int32 MaxSamplesPerSide = 4096;
+
+bool URTSGroundHeightfield::Bake(
+	const UWorld* World,
+	const FBox& Area,
+	const float InSampleSpacing,
+	const float TraceLength,
+	const ECollisionChannel CollisionChannel
+)
+{
+	if (World == nullptr || !Area.IsValid)
+	{
+		return false;
+	}
+
+	const FVector2D AreaSize(Area.GetSize());
+	const FVector2D AreaOrigin(Area.Min);
+	const float Spacing = FMath::Max3(
+		InSampleSpacing,
+		1.0f,
+		static_cast<float>(AreaSize.GetMax() / (MaxSamplesPerSide - 1))
+	);
+	const FIntPoint SampleCount(
+		FMath::Clamp(FMath::CeilToInt(AreaSize.X / Spacing) + 1, 2, MaxSamplesPerSide),
+		FMath::Clamp(FMath::CeilToInt(AreaSize.Y / Spacing) + 1, 2, MaxSamplesPerSide)
+	);
+
+	const FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(RTSGroundHeightfieldBake), true);
+
+	TArray<double> SampledHeights;
+	TBitArray<> SampledGround(false, SampleCount.X * SampleCount.Y);
+	SampledHeights.SetNumZeroed(SampleCount.X * SampleCount.Y);
+
+	for (int32 Y = 0; Y < SampleCount.Y; Y++)
+	{
+		for (int32 X = 0; X < SampleCount.X; X++)
+		{
+			const FVector2D Location = AreaOrigin + FVector2D(X, Y) * Spacing;
+
+			FHitResult HitResult;
+			if (World->LineTraceSingleByChannel(
+				HitResult,
+				FVector(Location.X, Location.Y, TraceLength),
+				FVector(Location.X, Location.Y, -TraceLength),
+				CollisionChannel,
+				QueryParams
+			))
+			{
+				const int32 Index = Y * SampleCount.X + X;
+				SampledHeights[Index] = HitResult.Location.Z;
+				SampledGround[Index] = true;
+			}
+		}
+	}
+
+	return this->Build(AreaOrigin, Spacing, SampleCount, SampledHeights, SampledGround);
+}
+
+bool URTSGroundHeightfield::Build(
+	const FVector2D& InOrigin,
+	const float InSampleSpacing,
+	const FIntPoint& InSize,
+	const TConstArrayView<double> SampledHeights,
+	const TBitArray<>& SampledGround
+)
+{
+	check(SampledHeights.Num() == InSize.X * InSize.Y && SampledGround.Num() == SampledHeights.Num());
+
+	this->Origin = InOrigin;
+	this->SampleSpacing = InSampleSpacing;
+	this->Size = InSize;
+	this->Heights.Reset();
+	this->Mips.Reset();
+
+	double LowestHeight = TNumericLimits<double>::Max();
+	double HighestHeight = TNumericLimits<double>::Lowest();
+	for (TConstSetBitIterator<> GroundIt(SampledGround); GroundIt; ++GroundIt)
+	{
+		LowestHeight = FMath::Min(LowestHeight, SampledHeights[GroundIt.GetIndex()]);
+		HighestHeight = FMath::Max(HighestHeight, SampledHeights[GroundIt.GetIndex()]);
+	}
+
+	if (LowestHeight > HighestHeight || InSize.X < 2 || InSize.Y < 2)
+	{
+		this->Size = FIntPoint::ZeroValue;
+		this->MarkPackageDirty();
+		return false;
+	}
+
+	// The highest value is kept for NoGround
+	this->MinHeight = LowestHeight;
+	this->HeightStep = (HighestHeight - LowestHeight) / (NoGround - 1);
+
+	this->Heights.SetNumUninitialized(SampledHeights.Num());
+	for (int32 Index = 0; Index < SampledHeights.Num(); Index++)
+	{
+		if (!SampledGround[Index])
+		{
+			this->Heights[Index] = NoGround;
+			continue;
+		}
+
+		this->Heights[Index] = this->HeightStep > 0.0
+			? static_cast<uint16>(FMath::Clamp(
+				FMath::RoundToInt((SampledHeights[Index] - this->MinHeight) / this->HeightStep),
+				0,
+				NoGround - 1
+			))
+			: 0;
+	}
+
+	this->BuildMips();
+	this->MarkPackageDirty();
+	return true;
+}
+
+bool URTSGroundHeightfield::Contains(const FVector2D& Location) const
+{
+	if (!this->IsBaked())
+	{
+		return false;
+	}
+
+	const FVector2D GridLocation = (Location - this->Origin) / this->SampleSpacing;
+	return GridLocation.X >= 0.0 && GridLocation.X <= this->Size.X - 1
+		&& GridLocation.Y >= 0.0 && GridLocation.Y <= this->Size.Y - 1;
+}
+
+bool URTSGroundHeightfield::GetHeight(const FVector2D& Location, double& OutHeight) const
+{
+	if (!this->Contains(Location))
+	{
+		return false;
+	}
+
+	const FVector2D GridLocation = (Location - this->Origin) / this->SampleSpacing;
+	const FIntPoint BaseSample(
+		FMath::Min(FMath::FloorToInt(GridLocation.X), this->Size.X - 2),
+		FMath::Min(FMath::FloorToInt(GridLocation.Y), this->Size.Y - 2)
+	);
+	const FVector2D Alpha = GridLocation - FVector2D(BaseSample);
+
+	// Filtered the same way as FRTSGroundHeightCache, so heights don't jump where the camera leaves the baked area
+	double WeightedHeight = 0.0;
+	double TotalWeight = 0.0;
+	for (int32 Corner = 0; Corner < 4; Corner++)
+	{
+		const uint16 Height = this->Heights[(BaseSample.Y + (Corner >> 1)) * this->Size.X + BaseSample.X + (Corner & 1)];
+		if (Height == NoGround)
+		{
+			continue;
+		}
+
+		const double Weight = FMath::Max(
+			((Corner & 1) ? Alpha.X : 1.0 - Alpha.X) * ((Corner >> 1) ? Alpha.Y : 1.0 - Alpha.Y),
+			UE_KINDA_SMALL_NUMBER
+		);
+		WeightedHeight += this->Dequantize(Height) * Weight;
+		TotalWeight += Weight;
+	}
+
+	if (TotalWeight <= 0.0)
+	{
+		return false;
+	}
+
+	OutHeight = WeightedHeight / TotalWeight;
+	return true;
+}
+
+/**
+ * Picks the first mip whose cells are at least as large as the area, which then overlaps at most 2 by 2 of them
+ * @param Area World space
+ * @param OutMinHeight
+ * @param OutMaxHeight
+ * @return False if the area is outside the baked area or any cell under it has a sample without ground
+ */
+bool URTSGroundHeightfield::GetHeightRange(const FBox2D& Area, double& OutMinHeight, double& OutMaxHeight) const
+{
+	if (!this->IsBaked() || !Area.bIsValid)
+	{
+		return false;
+	}
+
+	const FVector2D GridMin = (Area.Min - this->Origin) / this->SampleSpacing;
+	const FVector2D GridMax = (Area.Max - this->Origin) / this->SampleSpacing;
+	if (GridMax.X < 0.0 || GridMax.Y < 0.0 || GridMin.X > this->Size.X - 1 || GridMin.Y > this->Size.Y - 1)
+	{
+		return false;
+	}
+
+	const FIntPoint MinSample(
+		FMath::Max(FMath::FloorToInt(GridMin.X), 0),
+		FMath::Max(FMath::FloorToInt(GridMin.Y), 0)
+	);
+	const FIntPoint MaxSample(
+		FMath::Min(FMath::CeilToInt(GridMax.X), this->Size.X - 1),
+		FMath::Min(FMath::CeilToInt(GridMax.Y), this->Size.Y - 1)
+	);
+	const int32 SampleSpan = FMath::Max(MaxSample.X - MinSample.X, MaxSample.Y - MinSample.Y);
+
+	// Cells of mip N span 2^(N + 1) samples
+	int32 MipIndex = 0;
+	while (MipIndex < this->Mips.Num() - 1 && (2 << MipIndex) < SampleSpan)
+	{
+		MipIndex++;
+	}
+
+	const FRTSGroundHeightfieldMip& Mip = this->Mips[MipIndex];
+	const int32 CellSpan = 2 << MipIndex;
+	const FIntPoint MinCell(
+		FMath::Min(MinSample.X / CellSpan, Mip.Size.X - 1),
+		FMath::Min(MinSample.Y / CellSpan, Mip.Size.Y - 1)
+	);
+	const FIntPoint MaxCell(
+		FMath::Min(FMath::Max(MaxSample.X - 1, MinSample.X) / CellSpan, Mip.Size.X - 1),
+		FMath::Min(FMath::Max(MaxSample.Y - 1, MinSample.Y) / CellSpan, Mip.Size.Y - 1)
+	);
+
+	uint16 LowestHeight = NoGround;
+	uint16 HighestHeight = 0;
+	for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+	{
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			const int32 Index = Y * Mip.Size.X + X;
+			if (Mip.MinHeights[Index] == NoGround)
+			{
+				return false;
+			}
+
+			LowestHeight = FMath::Min(LowestHeight, Mip.MinHeights[Index]);
+			HighestHeight = FMath::Max(HighestHeight, Mip.MaxHeights[Index]);
+		}
+	}
+
+	OutMinHeight = this->Dequantize(LowestHeight);
+	OutMaxHeight = this->Dequantize(HighestHeight);
+	return true;
+}
+
+/**
+ * Cells include the samples on their far edges too, so they bound the filtered height between those samples as well.
+ * Cells with any sample without ground have NoGround as both their lowest and highest height.
+ */
+void URTSGroundHeightfield::BuildMips()
+{
+	this->Mips.Reset();
+
+	FIntPoint SourceSize = this->Size - FIntPoint(1, 1);
+	do
+	{
+		FRTSGroundHeightfieldMip& Mip = this->Mips.AddDefaulted_GetRef();
+		Mip.Size = FIntPoint(FMath::DivideAndRoundUp(SourceSize.X, 2), FMath::DivideAndRoundUp(SourceSize.Y, 2));
+		Mip.MinHeights.Init(NoGround, Mip.Size.X * Mip.Size.Y);
+		Mip.MaxHeights.Init(NoGround, Mip.Size.X * Mip.Size.Y);
+
+		const FRTSGroundHeightfieldMip* SourceMip = this->Mips.Num() > 1 ? &this->Mips[this->Mips.Num() - 2] : nullptr;
+		for (int32 Y = 0; Y < Mip.Size.Y; Y++)
+		{
+			for (int32 X = 0; X < Mip.Size.X; X++)
+			{
+				uint16 LowestHeight = NoGround;
+				uint16 HighestHeight = 0;
+				bool HasHole = false;
+
+				if (SourceMip == nullptr)
+				{
+					for (int32 SampleY = Y * 2; SampleY <= FMath::Min(Y * 2 + 2, this->Size.Y - 1); SampleY++)
+					{
+						for (int32 SampleX = X * 2; SampleX <= FMath::Min(X * 2 + 2, this->Size.X - 1); SampleX++)
+						{
+							const uint16 Height = this->Heights[SampleY * this->Size.X + SampleX];
+							HasHole |= Height == NoGround;
+							LowestHeight = FMath::Min(LowestHeight, Height);
+							HighestHeight = FMath::Max(HighestHeight, Height);
+						}
+					}
+				} else
+				{
+					for (int32 SourceY = Y * 2; SourceY <= FMath::Min(Y * 2 + 1, SourceMip->Size.Y - 1); SourceY++)
+					{
+						for (int32 SourceX = X * 2; SourceX <= FMath::Min(X * 2 + 1, SourceMip->Size.X - 1); SourceX++)
+						{
+							const int32 SourceIndex = SourceY * SourceMip->Size.X + SourceX;
+							HasHole |= SourceMip->MinHeights[SourceIndex] == NoGround;
+							LowestHeight = FMath::Min(LowestHeight, SourceMip->MinHeights[SourceIndex]);
+							HighestHeight = FMath::Max(HighestHeight, SourceMip->MaxHeights[SourceIndex]);
+						}
+					}
+				}
+
+				if (!HasHole)
+				{
+					const int32 Index = Y * Mip.Size.X + X;
+					Mip.MinHeights[Index] = LowestHeight;
+					Mip.MaxHeights[Index] = HighestHeight;
+				}
+			}
+		}
+
+		SourceSize = Mip.Size;
+	}
+	while (SourceSize.X > 1 || SourceSize.Y > 1);
+}
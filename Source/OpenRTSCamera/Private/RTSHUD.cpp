@@ -3,7 +3,54 @@
 #include "RTSHUD.h"
 
 #include "RTSSelectable.h"
+#include "RTSSelectableRegistry.h"
+#include "RTSSelectorSubsystem.h"
 #include "Engine/Canvas.h"
+#include "HAL/IConsoleManager.h"
+
+static TAutoConsoleVariable<int32> CVarRTSSelectionQueryMode(
+	TEXT("OpenRTSCamera.Selection.QueryMode"),
+	2,
+	TEXT("How the HUD finds the actors inside the selection rectangle.\n")
+	TEXT(" 0: legacy AHUD::GetActorsInSelectionRectangle over every actor in the world\n")
+	TEXT(" 1: spatial grid candidates, selection proxy bounds projected one actor at a time\n")
+	TEXT(" 2: spatial grid candidates, selection proxy boxes projected in batches by the selection kernel"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarRTSSelectionMaxHoverQueryRate(
+	TEXT("OpenRTSCamera.Selection.MaxHoverQueryRate"),
+	0.0f,
+	TEXT("Maximum number of hover queries per second while a selection box is dragged, 0 for no limit.\n")
+	TEXT("The final selection query always runs."),
+	ECVF_Default
+);
+
+DECLARE_STATS_GROUP(TEXT("OpenRTSCamera"), STATGROUP_OpenRTSCamera, STATCAT_Advanced);
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Selection Input Latency (ms)"), STAT_RTSSelectionLatency, STATGROUP_OpenRTSCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Selection Input Latency (frames)"), STAT_RTSSelectionLatencyFrames, STATGROUP_OpenRTSCamera);
+
+/**
+ * Resolves the owners of the handles, skipping proxies as they have none
+ * @param Registry 
+ * @param Handles 
+ * @param OutActors 
+ */
+static void ResolveActors(
+	const URTSSelectableRegistry& Registry,
+	const TConstArrayView<FRTSSelectableHandle> Handles,
+	TArray<AActor*>& OutActors
+)
+{
+	OutActors.Reset();
+	for (const FRTSSelectableHandle& Handle : Handles)
+	{
+		if (AActor* Actor = Registry.ResolveActor(Handle))
+		{
+			OutActors.Add(Actor);
+		}
+	}
+}
 
 // Constructor implementation: Initializes default values.
 ARTSHUD::ARTSHUD()
@@ -34,6 +81,8 @@ void ARTSHUD::InitStartPosition()
 	PlayerController->GetMousePosition(MousePosition.X, MousePosition.Y);
 	
 	SelectionStart = MousePosition;
+	bHasLastHoverQuery = false;
+	bHasIncrementalHover = false;
 }
 
 void ARTSHUD::UpdateEndPosition()
@@ -59,7 +108,31 @@ void ARTSHUD::EndGroupSelection()
 	SelectionEnd = MousePosition;
 	
 	bIsDrawingSelectionBox = false;
+	
 	bIsPerformingFinalSelection = true;
+	FinalSelectionRequestTime = FPlatformTime::Seconds();
+	FinalSelectionRequestFrame = GFrameCounter;
+}
+
+/**
+ * Runs a pending final selection right away rather than waiting for the next DrawHUD.
+ * Only the selection kernel projects without the HUD canvas, so with any other query mode, or without a view,
+ * the selection stays pending and false is returned.
+ */
+bool ARTSHUD::ResolveFinalSelection()
+{
+	if(!bIsPerformingFinalSelection || CVarRTSSelectionQueryMode.GetValueOnGameThread() < 2)
+	{
+		return false;
+	}
+
+	if(!SelectionView.Init(PlayerController))
+	{
+		return false;
+	}
+
+	PerformSelection();
+	return true;
 }
 
 /**
@@ -105,8 +178,58 @@ void ARTSHUD::PerformSelection()
 	// UE_LOG(LogTemp, Warning, TEXT("HUD - Perform Selection"));
 	
 	// Array to store actors that are within the selection rectangle.
-	TArray<AActor*> SelectedActors;
-	GetActorsInSelectionRectangle<AActor>(SelectionStart, SelectionEnd, SelectedActors, false, false);
+	bHasSelectionView = SelectionView.Init(PlayerController);
+	const int32 QueryMode = CVarRTSSelectionQueryMode.GetValueOnGameThread();
+
+	if(!bIsPerformingFinalSelection)
+	{
+		// Holding the box still over the same units gives the same hover, which the subsystem already has
+		bool bViewUnchanged = false;
+		if(CanReuseHoverQuery(bViewUnchanged))
+		{
+			return;
+		}
+
+		// Only the box and the units moved, so only the strips it gained or lost and the units that moved can change
+		// what's hovered
+		if(QueryMode >= 2 && bViewUnchanged && PerformIncrementalHoverQuery())
+		{
+			bHasLastHoverQuery = true;
+			return;
+		}
+	}
+	
+	const URTSSelectableRegistry* Registry = GetWorld()->GetSubsystem<URTSSelectableRegistry>();
+	TArray<AActor*>& SelectedActors = SelectedActorsBuffer;
+	TArray<FRTSSelectableHandle>& SelectedHandles = SelectedHandlesBuffer;
+	SelectedActors.Reset();
+	SelectedHandles.Reset();
+	HoverHits.Reset();
+
+	if (QueryMode <= 0)
+	{
+		GetActorsInSelectionRectangle<AActor>(SelectionStart, SelectionEnd, SelectedActors, false, false);
+
+		for (const AActor* Actor : SelectedActors)
+		{
+			const FRTSSelectableHandle Handle = Registry ? Registry->FindHandle(Actor) : FRTSSelectableHandle();
+			if (Handle.IsSet())
+			{
+				SelectedHandles.Add(Handle);
+			}
+		}
+	} else
+	{
+		GetSelectablesInSelectionRectangle(SelectedHandles, QueryMode >= 2);
+
+		const bool bActorsBound = bIsPerformingFinalSelection
+			? OnSelectedActorsDelegate.IsBound()
+			: OnHoveredActorsDelegate.IsBound();
+		if (bActorsBound && Registry)
+		{
+			ResolveActors(*Registry, SelectedHandles, SelectedActors);
+		}
+	}
 
 	// if(SelectedActors.Num() > 2)
 	// {
@@ -120,10 +243,242 @@ void ARTSHUD::PerformSelection()
 	
 	if(bIsPerformingFinalSelection) {
 		OnSelectedActorsDelegate.Broadcast(SelectedActors);
+		OnSelectedHandlesDelegate.Broadcast(SelectedHandles);
+
+		LastSelectionLatencyMs = static_cast<float>((FPlatformTime::Seconds() - FinalSelectionRequestTime) * 1000.0);
+		LastSelectionLatencyFrames = static_cast<int32>(GFrameCounter - FinalSelectionRequestFrame);
+		SET_FLOAT_STAT(STAT_RTSSelectionLatency, LastSelectionLatencyMs);
+		SET_DWORD_STAT(STAT_RTSSelectionLatencyFrames, LastSelectionLatencyFrames);
 	} else
 	{
 		OnHoveredActorsDelegate.Broadcast(SelectedActors);
+		OnHoveredHandlesDelegate.Broadcast(SelectedHandles);
 	}
 
+	// A final selection unhovers everything, so the next hover has to be queried regardless
+	bHasLastHoverQuery = !bIsPerformingFinalSelection;
+	bHasIncrementalHover = !bIsPerformingFinalSelection && QueryMode >= 2 && bHasSelectionView;
+	LastHoverRect = GetSelectionRectangle();
+	LastHoverMoveCount = Registry ? Registry->GetMoveCount() : 0;
 	bIsPerformingFinalSelection = false;
 }
+
+/**
+ * Checks whether the hover query can be skipped this frame, either because nothing it depends on has changed
+ * since the last one or because the hover query rate limit hasn't elapsed yet.
+ * Records the key and time of the query that's about to run otherwise.
+ * @param bOutViewUnchanged Whether only the selection box and where selectables are changed since the last query
+ */
+bool ARTSHUD::CanReuseHoverQuery(bool& bOutViewUnchanged)
+{
+	const URTSSelectableRegistry* Registry = GetWorld()->GetSubsystem<URTSSelectableRegistry>();
+	
+	FSelectionQueryKey Key;
+	Key.SelectionStart = SelectionStart;
+	Key.SelectionEnd = SelectionEnd;
+	Key.ViewOrigin = SelectionView.ViewOrigin;
+	Key.ViewProjection = SelectionView.ViewProjection;
+	Key.RegistryTopologyGeneration = Registry ? Registry->GetTopologyGeneration() : 0;
+	Key.RegistryMoveCount = Registry ? Registry->GetMoveCount() : 0;
+
+	const double Now = GetWorld()->GetRealTimeSeconds();
+
+	bOutViewUnchanged = false;
+	if(bHasLastHoverQuery && bHasSelectionView)
+	{
+		bOutViewUnchanged = Key.ViewOrigin == LastHoverQueryKey.ViewOrigin
+			&& Key.ViewProjection == LastHoverQueryKey.ViewProjection
+			&& Key.RegistryTopologyGeneration == LastHoverQueryKey.RegistryTopologyGeneration;
+
+		if(Key == LastHoverQueryKey)
+		{
+			return true;
+		}
+
+		const float MaxHoverQueryRate = CVarRTSSelectionMaxHoverQueryRate.GetValueOnGameThread();
+		if(MaxHoverQueryRate > 0.0f && Now - LastHoverQueryTime < 1.0 / MaxHoverQueryRate)
+		{
+			return true;
+		}
+	}
+
+	LastHoverQueryKey = Key;
+	LastHoverQueryTime = Now;
+	return false;
+}
+
+/**
+ * Updates the last hover result by re-testing only the selectables the screen projection cache puts near the
+ * difference between the last and current selection rectangles, plus the ones that moved since the last query,
+ * broadcasting the ones that entered and left.
+ * Returns false when there's no previous kernel result to build on.
+ */
+bool ARTSHUD::PerformIncrementalHoverQuery()
+{
+	const URTSSelectableRegistry* Registry = GetWorld()->GetSubsystem<URTSSelectableRegistry>();
+	if (!bHasIncrementalHover || Registry == nullptr)
+	{
+		return false;
+	}
+
+	// The view is the same as the last query's, so projecting once here pays off over the rest of the drag
+	const FRTSScreenProjectionCache* Projections = URTSSelectorSubsystem::Get(PlayerController)->GetScreenProjections();
+	if (Projections == nullptr || !Projections->IsValidFor(SelectionView, *Registry))
+	{
+		return false;
+	}
+
+	// Too many moves to catch up on, the whole query is cheaper
+	TArray<FRTSSelectableHandle>& Moved = MovedHandlesBuffer;
+	Moved.Reset();
+	if (!Registry->GatherMovedSince(LastHoverMoveCount, Moved))
+	{
+		return false;
+	}
+
+	const FBox2D SelectionRectangle = GetSelectionRectangle();
+	TArray<int32>& Changed = ProjectedIndicesBuffer;
+	Changed.Reset();
+	Projections->GatherChanged(LastHoverRect, SelectionRectangle, Changed);
+
+	for (const FRTSSelectableHandle& Handle : Moved)
+	{
+		const int32 Index = Projections->FindIndex(Handle);
+		if (Index != INDEX_NONE)
+		{
+			Changed.Add(Index);
+		}
+	}
+
+	HoverEnteredBuffer.Reset();
+	HoverLeftBuffer.Reset();
+	for (const int32 Index : Changed)
+	{
+		const FRTSSelectableHandle& Handle = Projections->GetHandle(Index);
+		if (Projections->Overlaps(Index, SelectionRectangle))
+		{
+			bool bAlreadyHit = false;
+			HoverHits.Add(Handle, &bAlreadyHit);
+			if (!bAlreadyHit)
+			{
+				HoverEnteredBuffer.Add(Handle);
+			}
+		} else if (HoverHits.Remove(Handle) > 0)
+		{
+			HoverLeftBuffer.Add(Handle);
+		}
+	}
+
+	LastHoverRect = SelectionRectangle;
+	LastHoverMoveCount = Registry->GetMoveCount();
+
+	if (HoverEnteredBuffer.Num() > 0 || HoverLeftBuffer.Num() > 0)
+	{
+		if (OnHoveredActorsDeltaDelegate.IsBound())
+		{
+			ResolveActors(*Registry, HoverEnteredBuffer, HoverEnteredActorsBuffer);
+			ResolveActors(*Registry, HoverLeftBuffer, HoverLeftActorsBuffer);
+			OnHoveredActorsDeltaDelegate.Broadcast(HoverEnteredActorsBuffer, HoverLeftActorsBuffer);
+		}
+
+		OnHoveredHandlesDeltaDelegate.Broadcast(HoverEnteredBuffer, HoverLeftBuffer);
+	}
+
+	return true;
+}
+
+FBox2D ARTSHUD::GetSelectionRectangle() const
+{
+	FBox2D SelectionRectangle(ForceInit);
+	SelectionRectangle += SelectionStart;
+	SelectionRectangle += SelectionEnd;
+	return SelectionRectangle;
+}
+
+/**
+ * Counterpart to GetActorsInSelectionRectangle<AActor>(SelectionStart, SelectionEnd, OutActors, false, false)
+ * that only considers selectables from the spatial registry whose grid cells overlap the ground footprint
+ * of the selection rectangle, and tests their selection proxies rather than every component's bounds.
+ * @param OutHandles 
+ * @param bUseSelectionKernel Test packed selection proxy boxes in batches rather than one at a time
+ */
+void ARTSHUD::GetSelectablesInSelectionRectangle(TArray<FRTSSelectableHandle>& OutHandles, const bool bUseSelectionKernel)
+{
+	const URTSSelectableRegistry* Registry = GetWorld()->GetSubsystem<URTSSelectableRegistry>();
+	if (Registry == nullptr)
+	{
+		return;
+	}
+
+	const FBox2D SelectionRectangle = GetSelectionRectangle();
+
+	// Reuse this frame's projections when something already made them, e.g. the release after a drag with a
+	// still camera, rather than projecting the candidates again
+	const FRTSScreenProjectionCache* Projections = bUseSelectionKernel && bHasSelectionView
+		? URTSSelectorSubsystem::Get(PlayerController)->FindScreenProjections(SelectionView)
+		: nullptr;
+	if (Projections != nullptr)
+	{
+		TArray<int32>& Hits = ProjectedIndicesBuffer;
+		Hits.Reset();
+		Projections->GatherInRect(SelectionRectangle, Hits);
+
+		for (const int32 Index : Hits)
+		{
+			OutHandles.Add(Projections->GetHandle(Index));
+			HoverHits.Add(Projections->GetHandle(Index));
+		}
+		return;
+	}
+
+	TArray<FRTSSelectableHandle>& Candidates = CandidatesBuffer;
+	Candidates.Reset();
+	FBox2D Footprint;
+	if (Registry->GetScreenRectGroundFootprint(PlayerController, SelectionStart, SelectionEnd, Footprint))
+	{
+		Registry->GatherInFootprint(Footprint, Candidates);
+	} else
+	{
+		Registry->GatherAll(Candidates);
+	}
+
+	if (bUseSelectionKernel && bHasSelectionView)
+	{
+		Registry->PackBounds(Candidates, CandidateBoundsBuffer);
+		FRTSSelectionKernel::TestRect(SelectionView, CandidateBoundsBuffer, SelectionRectangle, CandidateHitsBuffer);
+
+		for (int32 Index = 0; Index < Candidates.Num(); Index++)
+		{
+			if (CandidateHitsBuffer[Index])
+			{
+				OutHandles.Add(Candidates[Index]);
+				HoverHits.Add(Candidates[Index]);
+			}
+		}
+		return;
+	}
+
+	for (const FRTSSelectableHandle& Candidate : Candidates)
+	{
+		// Proxies only have the box around their bounding sphere
+		const URTSSelectable* Selectable = Registry->Resolve(Candidate);
+		const FBox ActorBounds = Selectable
+			? Selectable->GetSelectionProxyWorldBounds()
+			: Registry->GetBoundingBox(Candidate);
+
+		FVector BoxPoints[8];
+		ActorBounds.GetVertices(BoxPoints);
+
+		FBox2D ActorBox2D(ForceInit);
+		for (const FVector& BoxPoint : BoxPoints)
+		{
+			const FVector ProjectedWorldLocation = Project(BoxPoint);
+			ActorBox2D += FVector2D(ProjectedWorldLocation.X, ProjectedWorldLocation.Y);
+		}
+
+		if (SelectionRectangle.Intersect(ActorBox2D))
+		{
+			OutHandles.Add(Candidate);
+		}
+	}
+}
@@ -0,0 +1,244 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSScreenProjectionCache.h"
+
+bool FRTSScreenProjectionCache::IsValidFor(const FRTSSelectionView& View, const URTSSelectableRegistry& Registry) const
+{
+	return bIsValid
+		&& RegistryTopologyGeneration == Registry.GetTopologyGeneration()
+		&& RegistryMoveCount == Registry.GetMoveCount()
+		&& ViewOrigin == View.ViewOrigin
+		&& ViewProjection == View.ViewProjection
+		&& ViewRect == View.ViewRect;
+}
+
+/**
+ * Projects every registered selectable and buckets the results into the screen grid
+ * @param View
+ * @param Registry
+ */
+void FRTSScreenProjectionCache::Rebuild(const FRTSSelectionView& View, const URTSSelectableRegistry& Registry)
+{
+	ViewOrigin = View.ViewOrigin;
+	ViewProjection = View.ViewProjection;
+	ViewRect = View.ViewRect;
+	RegistryTopologyGeneration = Registry.GetTopologyGeneration();
+	RegistryMoveCount = Registry.GetMoveCount();
+	bIsValid = true;
+
+	Handles.Reset();
+	Registry.GatherAll(Handles);
+	Registry.PackBounds(Handles, Bounds);
+	FRTSSelectionKernel::ProjectToScreen(View, Bounds, ScreenRects);
+
+	int32 MaxSlot = INDEX_NONE;
+	for (const FRTSSelectableHandle& Handle : Handles)
+	{
+		MaxSlot = FMath::Max(MaxSlot, Handle.Index);
+	}
+
+	SlotToIndex.SetNumUninitialized(MaxSlot + 1, false);
+	for (int32& Index : SlotToIndex)
+	{
+		Index = INDEX_NONE;
+	}
+
+	for (int32 Index = 0; Index < Handles.Num(); Index++)
+	{
+		SlotToIndex[Handles[Index].Index] = Index;
+	}
+
+	BuildGrid();
+}
+
+/**
+ * Re-projects the selectables that moved since the cache was last brought up to date, rebuilding everything only
+ * when the view or the registry's topology changed, or the registry no longer knows what moved
+ * @param View
+ * @param Registry
+ */
+void FRTSScreenProjectionCache::Update(const FRTSSelectionView& View, const URTSSelectableRegistry& Registry)
+{
+	if (IsValidFor(View, Registry))
+	{
+		return;
+	}
+
+	const bool bSameView = bIsValid
+		&& RegistryTopologyGeneration == Registry.GetTopologyGeneration()
+		&& ViewOrigin == View.ViewOrigin
+		&& ViewProjection == View.ViewProjection
+		&& ViewRect == View.ViewRect;
+
+	MovedHandles.Reset();
+	if (!bSameView || !Registry.GatherMovedSince(RegistryMoveCount, MovedHandles) || MovedHandles.Num() >= Handles.Num())
+	{
+		Rebuild(View, Registry);
+		return;
+	}
+
+	RegistryMoveCount = Registry.GetMoveCount();
+	Registry.PackBounds(MovedHandles, Bounds);
+	FRTSSelectionKernel::ProjectToScreen(View, Bounds, MovedScreenRects);
+
+	// The grid only needs re-bucketing when a box crossed into other cells, which slow units rarely do
+	bool bCellsChanged = false;
+	for (int32 Moved = 0; Moved < MovedHandles.Num(); Moved++)
+	{
+		const int32 Index = FindIndex(MovedHandles[Moved]);
+		if (Index == INDEX_NONE)
+		{
+			continue;
+		}
+
+		FIntPoint OldMinCell;
+		FIntPoint OldMaxCell;
+		FIntPoint NewMinCell;
+		FIntPoint NewMaxCell;
+		const bool bWasInGrid = ScreenRects[Index].bIsValid
+			&& GetCellRange(FBox2D(ScreenRects[Index]), OldMinCell, OldMaxCell);
+		const bool bIsInGrid = MovedScreenRects[Moved].bIsValid
+			&& GetCellRange(FBox2D(MovedScreenRects[Moved]), NewMinCell, NewMaxCell);
+		bCellsChanged |= bWasInGrid != bIsInGrid
+			|| (bIsInGrid && (OldMinCell != NewMinCell || OldMaxCell != NewMaxCell));
+
+		ScreenRects[Index] = MovedScreenRects[Moved];
+	}
+
+	if (bCellsChanged)
+	{
+		BuildGrid();
+	}
+}
+
+void FRTSScreenProjectionCache::BuildGrid()
+{
+	GridSize = FIntPoint(
+		FMath::Max(FMath::DivideAndRoundUp(ViewRect.Width(), CellSize), 1),
+		FMath::Max(FMath::DivideAndRoundUp(ViewRect.Height(), CellSize), 1)
+	);
+	const int32 NumCells = GridSize.X * GridSize.Y;
+
+	// Counting sort into the cells, first count how many selectables land in each
+	CellStarts.SetNumZeroed(NumCells + 1, false);
+	for (const FBox2f& ScreenRect : ScreenRects)
+	{
+		FIntPoint MinCell;
+		FIntPoint MaxCell;
+		if (ScreenRect.bIsValid && GetCellRange(FBox2D(ScreenRect), MinCell, MaxCell))
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+			{
+				for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+				{
+					CellStarts[Y * GridSize.X + X + 1]++;
+				}
+			}
+		}
+	}
+
+	for (int32 Cell = 0; Cell < NumCells; Cell++)
+	{
+		CellStarts[Cell + 1] += CellStarts[Cell];
+	}
+
+	// Then fill them in
+	CellEntries.SetNumUninitialized(CellStarts[NumCells], false);
+	CellCursors.Reset();
+	CellCursors.Append(CellStarts.GetData(), NumCells);
+
+	for (int32 Index = 0; Index < ScreenRects.Num(); Index++)
+	{
+		FIntPoint MinCell;
+		FIntPoint MaxCell;
+		if (ScreenRects[Index].bIsValid && GetCellRange(FBox2D(ScreenRects[Index]), MinCell, MaxCell))
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+			{
+				for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+				{
+					CellEntries[CellCursors[Y * GridSize.X + X]++] = Index;
+				}
+			}
+		}
+	}
+}
+
+void FRTSScreenProjectionCache::GatherChanged(const FBox2D& OldRect, const FBox2D& NewRect, TArray<int32>& OutIndices) const
+{
+	FIntPoint MinCell;
+	FIntPoint MaxCell;
+	if (!bIsValid || !GetCellRange(OldRect + NewRect, MinCell, MaxCell))
+	{
+		return;
+	}
+
+	for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+	{
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			const FVector2D CellMin(ViewRect.Min.X + X * CellSize, ViewRect.Min.Y + Y * CellSize);
+			const FBox2D CellBox(CellMin, CellMin + FVector2D(CellSize, CellSize));
+
+			// Cells that both rectangles cover, or that neither touches, can't change anything
+			const bool bInsideBoth = OldRect.IsInside(CellBox) && NewRect.IsInside(CellBox);
+			const bool bOutsideBoth = !OldRect.Intersect(CellBox) && !NewRect.Intersect(CellBox);
+			if (bInsideBoth || bOutsideBoth)
+			{
+				continue;
+			}
+
+			const int32 Cell = Y * GridSize.X + X;
+			OutIndices.Append(&CellEntries[CellStarts[Cell]], CellStarts[Cell + 1] - CellStarts[Cell]);
+		}
+	}
+}
+
+void FRTSScreenProjectionCache::GatherInRect(const FBox2D& Rect, TArray<int32>& OutIndices) const
+{
+	FIntPoint MinCell;
+	FIntPoint MaxCell;
+	if (!bIsValid || !GetCellRange(Rect, MinCell, MaxCell))
+	{
+		return;
+	}
+
+	for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+	{
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			const int32 Cell = Y * GridSize.X + X;
+			for (int32 Entry = CellStarts[Cell]; Entry < CellStarts[Cell + 1]; Entry++)
+			{
+				const int32 Index = CellEntries[Entry];
+				if (!Overlaps(Index, Rect))
+				{
+					continue;
+				}
+
+				// Selectables spanning several cells are only reported from the first of them inside the range
+				FIntPoint EntryMinCell;
+				FIntPoint EntryMaxCell;
+				GetCellRange(FBox2D(ScreenRects[Index]), EntryMinCell, EntryMaxCell);
+				if (FMath::Max(EntryMinCell.X, MinCell.X) == X && FMath::Max(EntryMinCell.Y, MinCell.Y) == Y)
+				{
+					OutIndices.Add(Index);
+				}
+			}
+		}
+	}
+}
+
+bool FRTSScreenProjectionCache::GetCellRange(const FBox2D& Rect, FIntPoint& OutMin, FIntPoint& OutMax) const
+{
+	OutMin = FIntPoint(
+		FMath::Max(FMath::FloorToInt((Rect.Min.X - ViewRect.Min.X) / CellSize), 0),
+		FMath::Max(FMath::FloorToInt((Rect.Min.Y - ViewRect.Min.Y) / CellSize), 0)
+	);
+	OutMax = FIntPoint(
+		FMath::Min(FMath::FloorToInt((Rect.Max.X - ViewRect.Min.X) / CellSize), GridSize.X - 1),
+		FMath::Min(FMath::FloorToInt((Rect.Max.Y - ViewRect.Min.Y) / CellSize), GridSize.Y - 1)
+	);
+
+	return OutMin.X <= OutMax.X && OutMin.Y <= OutMax.Y;
+}
@@ -3,13 +3,49 @@
 #include "RTSSelectable.h"
 
 #include "Engine/LocalPlayer.h"
+#include "RTSSelectableRegistry.h"
 #include "RTSSelectorSubsystem.h"
 
 void URTSSelectable::BeginPlay()
 {
 	Super::BeginPlay();
 	
-	SelectorSubsystem = GetWorld()->GetFirstLocalPlayerFromController()->GetSubsystem<URTSSelectorSubsystem>();
+	// There's no local player on a dedicated server, but the registry is still needed there for server side queries
+	if (const ULocalPlayer* LocalPlayer = GetWorld()->GetFirstLocalPlayerFromController())
+	{
+		SelectorSubsystem = LocalPlayer->GetSubsystem<URTSSelectorSubsystem>();
+	}
+	SelectableRegistry = GetWorld()->GetSubsystem<URTSSelectableRegistry>();
+
+	CacheSelectionProxy();
+
+	if (SelectableRegistry)
+	{
+		SelectableHandle = SelectableRegistry->RegisterSelectable(this);
+
+		// Keep the spatial grid up to date as the owner moves
+		if (USceneComponent* OwnerRoot = GetOwner()->GetRootComponent())
+		{
+			OwnerTransformUpdatedHandle = OwnerRoot->TransformUpdated.AddUObject(this, &URTSSelectable::OnOwnerTransformUpdated);
+		}
+	}
+}
+
+void URTSSelectable::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (SelectableRegistry)
+	{
+		if (USceneComponent* OwnerRoot = GetOwner()->GetRootComponent())
+		{
+			OwnerRoot->TransformUpdated.Remove(OwnerTransformUpdatedHandle);
+		}
+		
+		SelectableRegistry->UnregisterSelectable(SelectableHandle);
+		SelectableRegistry = nullptr;
+		SelectableHandle = FRTSSelectableHandle();
+	}
+	
+	Super::EndPlay(EndPlayReason);
 }
 
 /*
@@ -42,6 +78,36 @@ void URTSSelectable::BindToEndCursorOverEvent(AActor* Owner)
 	}
 }
 
+/**
+ * Recaches the selection proxy after its shape or size has changed and updates the registry's bounds for it
+ */
+void URTSSelectable::RefreshSelectionProxy()
+{
+	CacheSelectionProxy();
+
+	if (SelectableRegistry)
+	{
+		SelectableRegistry->RefreshSelectableBounds(SelectableHandle);
+	}
+}
+
+/**
+ * World space box around the selection proxy
+ */
+FBox URTSSelectable::GetSelectionProxyWorldBounds() const
+{
+	const FTransform& OwnerTransform = GetOwner()->GetActorTransform();
+
+	// Spheres are the same from every angle, so avoid the looser box that transforming a rotated cube would give
+	if (ProxyShape == ESelectionProxyShape::Sphere)
+	{
+		const FVector Center = OwnerTransform.TransformPosition(ProxyLocalBounds.GetCenter());
+		return FBox::BuildAABB(Center, FVector(ProxyLocalSphereRadius * OwnerTransform.GetScale3D().GetAbsMax()));
+	}
+
+	return ProxyLocalBounds.TransformBy(OwnerTransform);
+}
+
 ESelectionState URTSSelectable::GetSelectionState() const
 {
 	return CurrentSelectionState;
@@ -53,7 +119,7 @@ void URTSSelectable::Select()
 	bHovered = false;
 	CurrentSelectionState = ESelectionState::Selected;
 	
-	OnSelectionStateChangedDelegate.Broadcast(CurrentSelectionState);
+	NotifySelectionStateChanged();
 }
 
 void URTSSelectable::Deselect()
@@ -66,7 +132,7 @@ void URTSSelectable::Deselect()
 		CurrentSelectionState = ESelectionState::None;
 	}
 	
-	OnSelectionStateChangedDelegate.Broadcast(CurrentSelectionState);
+	NotifySelectionStateChanged();
 }
 
 void URTSSelectable::HoverStart()
@@ -74,7 +140,7 @@ void URTSSelectable::HoverStart()
 	bHovered = true;
 	CurrentSelectionState = ESelectionState::Hovered;
 	
-	OnSelectionStateChangedDelegate.Broadcast(CurrentSelectionState);
+	NotifySelectionStateChanged();
 }
 
 void URTSSelectable::HoverEnd()
@@ -87,15 +153,88 @@ void URTSSelectable::HoverEnd()
 		CurrentSelectionState = ESelectionState::None;
 	}
 	
-	OnSelectionStateChangedDelegate.Broadcast(CurrentSelectionState);
+	NotifySelectionStateChanged();
+}
+
+bool URTSSelectable::ConsumeSelectionStateChange()
+{
+	bSelectionStateDirty = false;
+
+	if (NotifiedSelectionState == CurrentSelectionState)
+	{
+		return false;
+	}
+
+	NotifiedSelectionState = CurrentSelectionState;
+	return true;
 }
 
 void URTSSelectable::OnBeginCursorOver(AActor* TouchedActor)
 {
-	SelectorSubsystem->RegisterHoverStart(this);
+	if (SelectorSubsystem)
+	{
+		SelectorSubsystem->RegisterHoverStart(this);
+	}
 }
 
 void URTSSelectable::OnEndCursorOver(AActor* TouchedActor)
 {
-	SelectorSubsystem->RegisterHoverEnd(this);
+	if (SelectorSubsystem)
+	{
+		SelectorSubsystem->RegisterHoverEnd(this);
+	}
+}
+
+void URTSSelectable::CacheSelectionProxy()
+{
+	switch (ProxyShape)
+	{
+	case ESelectionProxyShape::Sphere:
+		ProxyLocalBounds = FBox::BuildAABB(ProxyOffset, FVector(ProxyRadius));
+		ProxyLocalSphereRadius = ProxyRadius;
+		break;
+	case ESelectionProxyShape::Capsule:
+		{
+			const float HalfHeight = FMath::Max(ProxyHalfHeight, ProxyRadius);
+			ProxyLocalBounds = FBox::BuildAABB(ProxyOffset, FVector(ProxyRadius, ProxyRadius, HalfHeight));
+			ProxyLocalSphereRadius = HalfHeight;
+		}
+		break;
+	case ESelectionProxyShape::Box:
+		ProxyLocalBounds = FBox::BuildAABB(ProxyOffset, ProxyExtent.GetAbs());
+		ProxyLocalSphereRadius = ProxyExtent.Size();
+		break;
+	default:
+		{
+			const FBox ComponentBounds = GetOwner()->CalculateComponentsBoundingBoxInLocalSpace(false);
+			ProxyLocalBounds = ComponentBounds.IsValid ? ComponentBounds : FBox(FVector::ZeroVector, FVector::ZeroVector);
+			ProxyLocalSphereRadius = ProxyLocalBounds.GetExtent().Size();
+		}
+		break;
+	}
+}
+
+/**
+ * Queues the state change with the selector subsystem, which broadcasts it once at the end of the frame no matter
+ * how many times the state changed in between. Without a subsystem the change is broadcast right away.
+ */
+void URTSSelectable::NotifySelectionStateChanged()
+{
+	if (SelectorSubsystem)
+	{
+		if (!bSelectionStateDirty)
+		{
+			bSelectionStateDirty = true;
+			SelectorSubsystem->MarkSelectionStateDirty(this);
+		}
+		return;
+	}
+
+	NotifiedSelectionState = CurrentSelectionState;
+	OnSelectionStateChangedDelegate.Broadcast(CurrentSelectionState);
+}
+
+void URTSSelectable::OnOwnerTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	SelectableRegistry->UpdateSelectable(SelectableHandle);
 }
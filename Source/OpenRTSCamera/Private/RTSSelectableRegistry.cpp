@@ -0,0 +1,764 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSSelectableRegistry.h"
+
+#include "SceneView.h"
+#include "Camera/CameraTypes.h"
+#include "GameFramework/Actor.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "RTSSelectable.h"
+#include "RTSSelectionKernel.h"
+
+static TAutoConsoleVariable<float> CVarRTSSelectionGridCellSize(
+	TEXT("OpenRTSCamera.Selection.GridCellSize"),
+	2000.0f,
+	TEXT("World space size of a cell in the selectable spatial grid. Read when the world starts."),
+	ECVF_Default
+);
+
+void URTSSelectableRegistry::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	CellSize = FMath::Max(CVarRTSSelectionGridCellSize.GetValueOnGameThread(), 1.0f);
+}
+
+void URTSSelectableRegistry::Deinitialize()
+{
+	Slots.Empty();
+	FreeSlots.Empty();
+	Entries.Empty();
+	ActorToHandle.Empty();
+	Cells.Empty();
+	ClassBuckets.Empty();
+	MovedSlots.Empty();
+	bHasBounds = false;
+
+	Super::Deinitialize();
+}
+
+/**
+ * Adds the selectable to the registry, caching the bounds of its selection proxy.
+ * @param Selectable
+ * @return Handle to pass back when the selectable moves or unregisters, unset if the selectable has no owner or
+ * its owner already has another one registered
+ */
+FRTSSelectableHandle URTSSelectableRegistry::RegisterSelectable(URTSSelectable* Selectable)
+{
+	AActor* Owner = Selectable ? Selectable->GetOwner() : nullptr;
+	if (Owner == nullptr)
+	{
+		return FRTSSelectableHandle();
+	}
+
+	// Each selectable unregisters its own handle, so a second one on the actor can't share the first one's entry
+	if (!ensureMsgf(
+		!ActorToHandle.Contains(Owner),
+		TEXT("%s already has a registered selectable, %s won't be selectable"),
+		*Owner->GetName(),
+		*Selectable->GetName()
+	))
+	{
+		return FRTSSelectableHandle();
+	}
+
+	const int32 SlotIndex = FreeSlots.Num() > 0 ? FreeSlots.Pop(false) : Slots.AddDefaulted();
+
+	FEntry Entry;
+	Entry.Selectable = Selectable;
+	Entry.Actor = Owner;
+	Entry.SlotIndex = SlotIndex;
+	CacheBounds(Entry);
+
+	Entry.Cell = GetCell(Entry.Center);
+	AddToCell(SlotIndex, Entry.Cell);
+	ExpandBounds(Entry);
+
+	Entry.ClassBucketIndex = ClassBuckets.FindOrAdd(Owner->GetClass()).Add(SlotIndex);
+
+	Slots[SlotIndex].EntryIndex = Entries.Add(Entry);
+
+	const FRTSSelectableHandle Handle = MakeHandle(SlotIndex);
+	ActorToHandle.Add(Owner, Handle);
+	Generation++;
+	TopologyGeneration++;
+	return Handle;
+}
+
+FRTSSelectableHandle URTSSelectableRegistry::RegisterProxy(const FVector& Center, const float Radius, const uint64 UserData)
+{
+	const int32 SlotIndex = FreeSlots.Num() > 0 ? FreeSlots.Pop(false) : Slots.AddDefaulted();
+
+	FEntry Entry;
+	Entry.SlotIndex = SlotIndex;
+	Entry.Center = Center;
+	Entry.SphereRadius = FMath::Max(Radius, 0.0f);
+	Entry.Extent = FVector(Entry.SphereRadius);
+	Entry.UserData = UserData;
+
+	Entry.Cell = GetCell(Entry.Center);
+	AddToCell(SlotIndex, Entry.Cell);
+	ExpandBounds(Entry);
+
+	Slots[SlotIndex].EntryIndex = Entries.Add(Entry);
+
+	Generation++;
+	TopologyGeneration++;
+	return MakeHandle(SlotIndex);
+}
+
+void URTSSelectableRegistry::UpdateProxy(const FRTSSelectableHandle& Handle, const FVector& Center)
+{
+	if (!IsValid(Handle))
+	{
+		return;
+	}
+
+	FEntry& Entry = Entries[Slots[Handle.Index].EntryIndex];
+	Entry.Center = Center;
+	UpdateCell(Entry);
+}
+
+/**
+ * Moves many proxies at once, e.g. from a processor iterating entity chunks
+ * @param Handles 
+ * @param Centers Same length and order as the handles
+ */
+void URTSSelectableRegistry::UpdateProxies(
+	const TConstArrayView<FRTSSelectableHandle> Handles,
+	const TConstArrayView<FVector> Centers
+)
+{
+	check(Handles.Num() == Centers.Num());
+
+	for (int32 Index = 0; Index < Handles.Num(); Index++)
+	{
+		UpdateProxy(Handles[Index], Centers[Index]);
+	}
+}
+
+void URTSSelectableRegistry::UnregisterSelectable(const FRTSSelectableHandle& Handle)
+{
+	if (!IsValid(Handle))
+	{
+		return;
+	}
+
+	OnSelectableUnregistered.Broadcast(Handle);
+
+	FSlot& Slot = Slots[Handle.Index];
+	const int32 EntryIndex = Slot.EntryIndex;
+	const FEntry& Entry = Entries[EntryIndex];
+
+	RemoveFromCell(Handle.Index, Entry.Cell);
+
+	if (Entry.Actor)
+	{
+		ActorToHandle.Remove(Entry.Actor);
+
+		// Swap the last of the class into this one's place in the bucket
+		TArray<int32>& ClassBucket = ClassBuckets.FindChecked(Entry.Actor->GetClass());
+		const int32 MovedSlotIndex = ClassBucket.Last();
+		ClassBucket[Entry.ClassBucketIndex] = MovedSlotIndex;
+		Entries[Slots[MovedSlotIndex].EntryIndex].ClassBucketIndex = Entry.ClassBucketIndex;
+		ClassBucket.Pop(false);
+	}
+
+	// Keep the entries dense by moving the last one into the hole
+	Entries.RemoveAtSwap(EntryIndex, 1, false);
+	if (Entries.IsValidIndex(EntryIndex))
+	{
+		Slots[Entries[EntryIndex].SlotIndex].EntryIndex = EntryIndex;
+	}
+
+	Slot.EntryIndex = INDEX_NONE;
+	Slot.Generation++;
+	FreeSlots.Add(Handle.Index);
+
+	if (Entries.Num() == 0)
+	{
+		bHasBounds = false;
+	}
+
+	Generation++;
+	TopologyGeneration++;
+}
+
+/**
+ * Moves the selectable's bounds along with its owner, changing cell if needed
+ * @param Handle
+ */
+void URTSSelectableRegistry::UpdateSelectable(const FRTSSelectableHandle& Handle)
+{
+	if (!IsValid(Handle))
+	{
+		return;
+	}
+
+	FEntry& Entry = Entries[Slots[Handle.Index].EntryIndex];
+	if (Entry.Actor == nullptr)
+	{
+		return;
+	}
+
+	// Rotating changes the box as well, so all of the bounds are cached again
+	CacheBounds(Entry);
+	UpdateCell(Entry);
+}
+
+/**
+ * Re-reads the selection proxy of the selectable, for when its shape changed after it registered
+ * @param Handle
+ */
+void URTSSelectableRegistry::RefreshSelectableBounds(const FRTSSelectableHandle& Handle)
+{
+	if (!IsValid(Handle))
+	{
+		return;
+	}
+
+	FEntry& Entry = Entries[Slots[Handle.Index].EntryIndex];
+	if (Entry.Selectable == nullptr)
+	{
+		return;
+	}
+
+	CacheBounds(Entry);
+	UpdateCell(Entry);
+}
+
+bool URTSSelectableRegistry::IsValid(const FRTSSelectableHandle& Handle) const
+{
+	return Slots.IsValidIndex(Handle.Index)
+		&& Slots[Handle.Index].Generation == Handle.Generation
+		&& Slots[Handle.Index].EntryIndex != INDEX_NONE;
+}
+
+URTSSelectable* URTSSelectableRegistry::Resolve(const FRTSSelectableHandle& Handle) const
+{
+	const FEntry* Entry = FindEntry(Handle);
+	return Entry ? Entry->Selectable : nullptr;
+}
+
+AActor* URTSSelectableRegistry::ResolveActor(const FRTSSelectableHandle& Handle) const
+{
+	const FEntry* Entry = FindEntry(Handle);
+	return Entry ? Entry->Actor : nullptr;
+}
+
+FRTSSelectableHandle URTSSelectableRegistry::FindHandle(const AActor* Actor) const
+{
+	const FRTSSelectableHandle* Handle = ActorToHandle.Find(Actor);
+	return Handle ? *Handle : FRTSSelectableHandle();
+}
+
+URTSSelectable* URTSSelectableRegistry::FindSelectable(const AActor* Actor) const
+{
+	const FRTSSelectableHandle* Handle = ActorToHandle.Find(Actor);
+	return Handle ? Entries[Slots[Handle->Index].EntryIndex].Selectable : nullptr;
+}
+
+bool URTSSelectableRegistry::IsProxy(const FRTSSelectableHandle& Handle) const
+{
+	const FEntry* Entry = FindEntry(Handle);
+	return Entry && Entry->Selectable == nullptr;
+}
+
+uint64 URTSSelectableRegistry::GetProxyUserData(const FRTSSelectableHandle& Handle) const
+{
+	const FEntry* Entry = FindEntry(Handle);
+	return Entry ? Entry->UserData : 0;
+}
+
+FBox URTSSelectableRegistry::GetBoundingBox(const FRTSSelectableHandle& Handle) const
+{
+	const FEntry* Entry = FindEntry(Handle);
+	return Entry ? FBox::BuildAABB(Entry->Center, Entry->Extent) : FBox(ForceInit);
+}
+
+/**
+ * Gathers every selectable registered in a cell overlapping the footprint.
+ * This is a broad phase, callers still need to test the selectables against the exact selection shape.
+ * @param Footprint World space XY area
+ * @param OutHandles
+ */
+void URTSSelectableRegistry::GatherInFootprint(const FBox2D& Footprint, TArray<FRTSSelectableHandle>& OutHandles) const
+{
+	if (!bHasBounds || !Footprint.bIsValid)
+	{
+		return;
+	}
+
+	const FIntPoint MinCell(
+		FMath::Max(FMath::FloorToInt(Footprint.Min.X / CellSize), MinOccupiedCell.X),
+		FMath::Max(FMath::FloorToInt(Footprint.Min.Y / CellSize), MinOccupiedCell.Y)
+	);
+	const FIntPoint MaxCell(
+		FMath::Min(FMath::FloorToInt(Footprint.Max.X / CellSize), MaxOccupiedCell.X),
+		FMath::Min(FMath::FloorToInt(Footprint.Max.Y / CellSize), MaxOccupiedCell.Y)
+	);
+
+	if (MinCell.X > MaxCell.X || MinCell.Y > MaxCell.Y)
+	{
+		return;
+	}
+
+	const auto AppendCell = [this, &OutHandles](const TArray<int32>& SlotIndices)
+	{
+		for (const int32 SlotIndex : SlotIndices)
+		{
+			OutHandles.Add(MakeHandle(SlotIndex));
+		}
+	};
+
+	// Shallow views can cover far more cells than are actually occupied, walk whichever is smaller
+	const int64 CellsInRange = int64(MaxCell.X - MinCell.X + 1) * int64(MaxCell.Y - MinCell.Y + 1);
+	if (CellsInRange > Cells.Num())
+	{
+		for (const auto& [Cell, SlotIndices] : Cells)
+		{
+			if (Cell.X >= MinCell.X && Cell.X <= MaxCell.X && Cell.Y >= MinCell.Y && Cell.Y <= MaxCell.Y)
+			{
+				AppendCell(SlotIndices);
+			}
+		}
+		return;
+	}
+
+	for (int32 Y = MinCell.Y; Y <= MaxCell.Y; Y++)
+	{
+		for (int32 X = MinCell.X; X <= MaxCell.X; X++)
+		{
+			if (const TArray<int32>* SlotIndices = Cells.Find(FIntPoint(X, Y)))
+			{
+				AppendCell(*SlotIndices);
+			}
+		}
+	}
+}
+
+void URTSSelectableRegistry::GatherAll(TArray<FRTSSelectableHandle>& OutHandles) const
+{
+	OutHandles.Reserve(OutHandles.Num() + Entries.Num());
+	for (const FEntry& Entry : Entries)
+	{
+		OutHandles.Add(MakeHandle(Entry.SlotIndex));
+	}
+}
+
+/**
+ * Gathers the selectables whose owners are exactly of the given class, without looking at any others
+ * @param Class 
+ * @param OutHandles 
+ */
+void URTSSelectableRegistry::GatherOfClass(const UClass* Class, TArray<FRTSSelectableHandle>& OutHandles) const
+{
+	if (const TArray<int32>* ClassBucket = ClassBuckets.Find(Class))
+	{
+		OutHandles.Reserve(OutHandles.Num() + ClassBucket->Num());
+		for (const int32 SlotIndex : *ClassBucket)
+		{
+			OutHandles.Add(MakeHandle(SlotIndex));
+		}
+	}
+}
+
+/**
+ * Gathers the selectables whose bounding spheres overlap a vertical cylinder
+ * @param Center World XY of the circle
+ * @param Radius 
+ * @param OutHandles 
+ */
+void URTSSelectableRegistry::GatherInCircle(
+	const FVector2D& Center,
+	const double Radius,
+	TArray<FRTSSelectableHandle>& OutHandles
+) const
+{
+	const FBox2D Area(Center - FVector2D(Radius), Center + FVector2D(Radius));
+	GatherInAreaWhere(Area, OutHandles, [&Center, Radius](const FEntry& Entry)
+	{
+		return FVector2D::DistSquared(FVector2D(Entry.Center), Center) <= FMath::Square(Radius + Entry.SphereRadius);
+	});
+}
+
+/**
+ * Gathers the selectables whose bounding spheres overlap a vertical prism over a convex polygon
+ * @param Polygon World XY corners in either winding order
+ * @param OutHandles 
+ */
+void URTSSelectableRegistry::GatherInConvexPolygon(
+	const TConstArrayView<FVector2D> Polygon,
+	TArray<FRTSSelectableHandle>& OutHandles
+) const
+{
+	if (Polygon.Num() < 3)
+	{
+		return;
+	}
+
+	FBox2D Area(ForceInit);
+	double TwiceSignedArea = 0.0;
+	for (int32 Index = 0; Index < Polygon.Num(); Index++)
+	{
+		Area += Polygon[Index];
+		TwiceSignedArea += FVector2D::CrossProduct(Polygon[Index], Polygon[(Index + 1) % Polygon.Num()]);
+	}
+	const double Winding = TwiceSignedArea < 0.0 ? -1.0 : 1.0;
+
+	GatherInAreaWhere(Area, OutHandles, [Polygon, Winding](const FEntry& Entry)
+	{
+		const FVector2D Point(Entry.Center);
+		const double RadiusSquared = FMath::Square(Entry.SphereRadius);
+
+		// Inside when on the inner side of every edge, otherwise it has to be within its radius of an edge
+		bool bInside = true;
+		double ClosestDistanceSquared = TNumericLimits<double>::Max();
+		for (int32 Index = 0; Index < Polygon.Num(); Index++)
+		{
+			const FVector2D& EdgeStart = Polygon[Index];
+			const FVector2D& EdgeEnd = Polygon[(Index + 1) % Polygon.Num()];
+			const FVector2D Edge = EdgeEnd - EdgeStart;
+
+			if (Winding * FVector2D::CrossProduct(Edge, Point - EdgeStart) < 0.0)
+			{
+				bInside = false;
+			}
+
+			const double EdgeLengthSquared = Edge.SizeSquared();
+			const double Alpha = EdgeLengthSquared > UE_SMALL_NUMBER
+				? FMath::Clamp(FVector2D::DotProduct(Point - EdgeStart, Edge) / EdgeLengthSquared, 0.0, 1.0)
+				: 0.0;
+			ClosestDistanceSquared = FMath::Min(ClosestDistanceSquared, FVector2D::DistSquared(Point, EdgeStart + Edge * Alpha));
+		}
+
+		return bInside || ClosestDistanceSquared <= RadiusSquared;
+	});
+}
+
+/**
+ * Gathers the selectables in cells overlapping the area, grown by the largest bounding sphere, that pass the predicate
+ * @param Area World XY area the predicate can pass in
+ * @param OutHandles 
+ * @param Predicate Takes an FEntry
+ */
+template <typename PredicateType>
+void URTSSelectableRegistry::GatherInAreaWhere(
+	const FBox2D& Area,
+	TArray<FRTSSelectableHandle>& OutHandles,
+	PredicateType Predicate
+) const
+{
+	const int32 FirstCandidate = OutHandles.Num();
+	GatherInFootprint(Area.ExpandBy(MaxRadius), OutHandles);
+
+	int32 NumKept = FirstCandidate;
+	for (int32 Index = FirstCandidate; Index < OutHandles.Num(); Index++)
+	{
+		const FRTSSelectableHandle Handle = OutHandles[Index];
+		if (Predicate(Entries[Slots[Handle.Index].EntryIndex]))
+		{
+			OutHandles[NumKept++] = Handle;
+		}
+	}
+	OutHandles.SetNum(NumKept, false);
+}
+
+/**
+ * Packs a bounding box per handle for the selection kernel, in the same order as the handles
+ * @param Handles Valid handles, e.g. straight from GatherInFootprint
+ * @param OutBounds 
+ */
+void URTSSelectableRegistry::PackBounds(TConstArrayView<FRTSSelectableHandle> Handles, FRTSSelectionBoundsSoA& OutBounds) const
+{
+	OutBounds.Reset();
+
+	for (const FRTSSelectableHandle& Handle : Handles)
+	{
+		const FEntry& Entry = Entries[Slots[Handle.Index].EntryIndex];
+		OutBounds.Add(Entry.Center, Entry.Extent);
+	}
+}
+
+/**
+ * Computes the world XY area that can contain selectables visible inside a screen space rectangle.
+ * The corner rays are intersected with the lowest and highest point of any registered selectable, so the
+ * footprint is conservative for uneven terrain. Fails when a corner ray never comes back down, e.g. the
+ * rectangle reaches above the horizon, in which case callers should fall back to GatherAll.
+ * @param PlayerController Controller whose view the rectangle is in
+ * @param FirstPoint Screen space corner
+ * @param SecondPoint Opposite screen space corner
+ * @param OutFootprint
+ * @return Whether the footprint is bounded
+ */
+bool URTSSelectableRegistry::GetScreenRectGroundFootprint(
+	const APlayerController* PlayerController,
+	const FVector2D& FirstPoint,
+	const FVector2D& SecondPoint,
+	FBox2D& OutFootprint
+) const
+{
+	OutFootprint = FBox2D(ForceInit);
+
+	if (PlayerController == nullptr || !bHasBounds)
+	{
+		return false;
+	}
+
+	const FVector2D Corners[4] = {
+		FirstPoint,
+		FVector2D(SecondPoint.X, FirstPoint.Y),
+		SecondPoint,
+		FVector2D(FirstPoint.X, SecondPoint.Y)
+	};
+	const double PlaneHeights[2] = {MinZ, MaxZ};
+
+	for (const FVector2D& Corner : Corners)
+	{
+		FVector RayOrigin;
+		FVector RayDirection;
+		if (!PlayerController->DeprojectScreenPositionToWorld(
+			static_cast<float>(Corner.X),
+			static_cast<float>(Corner.Y),
+			RayOrigin,
+			RayDirection
+		))
+		{
+			return false;
+		}
+
+		if (RayDirection.Z > -UE_KINDA_SMALL_NUMBER)
+		{
+			return false;
+		}
+
+		for (const double PlaneHeight : PlaneHeights)
+		{
+			// Clamping to the ray origin keeps the footprint correct when the camera is inside the height range
+			const double Distance = FMath::Max((PlaneHeight - RayOrigin.Z) / RayDirection.Z, 0.0);
+			const FVector Hit = RayOrigin + RayDirection * Distance;
+			OutFootprint += FVector2D(Hit.X, Hit.Y);
+		}
+	}
+
+	OutFootprint = OutFootprint.ExpandBy(MaxRadius);
+	return true;
+}
+
+/**
+ * Computes the ground area under a screen space rectangle of an arbitrary view, without needing a player controller,
+ * so servers can check a client's box against the view the client reported. The corner rays are intersected with the
+ * lowest and highest point of any registered selectable and the result is the convex hull of those hits.
+ * @param ViewInfo View the rectangle is in, its aspect ratio should match the viewport
+ * @param ViewportSize 
+ * @param FirstPoint Screen space corner
+ * @param SecondPoint Opposite screen space corner
+ * @param OutPolygon Counter clockwise world XY corners, for GatherInConvexPolygon
+ * @return Whether the area is bounded, false when the rectangle reaches above the horizon
+ */
+bool URTSSelectableRegistry::GetViewRectGroundPolygon(
+	const FMinimalViewInfo& ViewInfo,
+	const FIntPoint& ViewportSize,
+	const FVector2D& FirstPoint,
+	const FVector2D& SecondPoint,
+	TArray<FVector2D>& OutPolygon
+) const
+{
+	OutPolygon.Reset();
+
+	if (!bHasBounds || ViewportSize.X <= 0 || ViewportSize.Y <= 0)
+	{
+		return false;
+	}
+
+	FMatrix ViewMatrix;
+	FMatrix ProjectionMatrix;
+	FMatrix ViewProjectionMatrix;
+	UGameplayStatics::GetViewProjectionMatrix(ViewInfo, ViewMatrix, ProjectionMatrix, ViewProjectionMatrix);
+	const FMatrix InverseViewProjection = ViewProjectionMatrix.Inverse();
+	const FIntRect ViewRect(FIntPoint::ZeroValue, ViewportSize);
+
+	const FVector2D Corners[4] = {
+		FirstPoint,
+		FVector2D(SecondPoint.X, FirstPoint.Y),
+		SecondPoint,
+		FVector2D(FirstPoint.X, SecondPoint.Y)
+	};
+	const double PlaneHeights[2] = {MinZ, MaxZ};
+
+	TArray<FVector2D, TInlineAllocator<8>> Hits;
+	for (const FVector2D& Corner : Corners)
+	{
+		FVector RayOrigin;
+		FVector RayDirection;
+		FSceneView::DeprojectScreenToWorld(Corner, ViewRect, InverseViewProjection, RayOrigin, RayDirection);
+
+		if (RayDirection.Z > -UE_KINDA_SMALL_NUMBER)
+		{
+			return false;
+		}
+
+		for (const double PlaneHeight : PlaneHeights)
+		{
+			const double Distance = FMath::Max((PlaneHeight - RayOrigin.Z) / RayDirection.Z, 0.0);
+			Hits.Add(FVector2D(RayOrigin + RayDirection * Distance));
+		}
+	}
+
+	// Monotone chain convex hull, lower then upper
+	Hits.Sort([](const FVector2D& A, const FVector2D& B)
+	{
+		return A.X < B.X || (A.X == B.X && A.Y < B.Y);
+	});
+
+	const auto AddHullPoint = [&OutPolygon](const FVector2D& Point, const int32 MinHullSize)
+	{
+		while (OutPolygon.Num() >= MinHullSize
+			&& FVector2D::CrossProduct(OutPolygon.Last() - OutPolygon.Last(1), Point - OutPolygon.Last(1)) <= 0.0)
+		{
+			OutPolygon.Pop(false);
+		}
+		OutPolygon.Add(Point);
+	};
+
+	for (const FVector2D& Hit : Hits)
+	{
+		AddHullPoint(Hit, 2);
+	}
+
+	const int32 LowerHullSize = OutPolygon.Num() + 1;
+	for (int32 Index = Hits.Num() - 2; Index >= 0; Index--)
+	{
+		AddHullPoint(Hits[Index], LowerHullSize);
+	}
+
+	// The last point closes the loop back onto the first
+	OutPolygon.Pop(false);
+	return OutPolygon.Num() >= 3;
+}
+
+/**
+ * Gathers the selectables that moved after the given point, so caches of their bounds can patch just those.
+ * Selectables that moved more than once are gathered as many times.
+ * @param InMoveCount What GetMoveCount returned when the caller last caught up
+ * @param OutHandles
+ * @return False if the moves since then are no longer logged, the caller has to start over from everything
+ */
+bool URTSSelectableRegistry::GatherMovedSince(const uint32 InMoveCount, TArray<FRTSSelectableHandle>& OutHandles) const
+{
+	const uint32 NumMoved = MoveCount - InMoveCount;
+	if (NumMoved > static_cast<uint32>(MovedSlots.Num()))
+	{
+		return false;
+	}
+
+	for (int32 Index = MovedSlots.Num() - static_cast<int32>(NumMoved); Index < MovedSlots.Num(); Index++)
+	{
+		// Slots emptied since they moved changed the topology, which callers check for anyway
+		if (Slots[MovedSlots[Index]].EntryIndex != INDEX_NONE)
+		{
+			OutHandles.Add(MakeHandle(MovedSlots[Index]));
+		}
+	}
+
+	return true;
+}
+
+const URTSSelectableRegistry::FEntry* URTSSelectableRegistry::FindEntry(const FRTSSelectableHandle& Handle) const
+{
+	return IsValid(Handle) ? &Entries[Slots[Handle.Index].EntryIndex] : nullptr;
+}
+
+FRTSSelectableHandle URTSSelectableRegistry::MakeHandle(const int32 SlotIndex) const
+{
+	FRTSSelectableHandle Handle;
+	Handle.Index = SlotIndex;
+	Handle.Generation = Slots[SlotIndex].Generation;
+	return Handle;
+}
+
+/**
+ * Caches the world space box and bounding sphere around the selection proxy of the entry's selectable
+ * @param Entry 
+ */
+void URTSSelectableRegistry::CacheBounds(FEntry& Entry) const
+{
+	const FTransform& ActorTransform = Entry.Actor->GetActorTransform();
+	const FBox WorldBounds = Entry.Selectable->GetSelectionProxyWorldBounds();
+	Entry.Center = WorldBounds.GetCenter();
+	Entry.Extent = WorldBounds.GetExtent();
+	Entry.SphereRadius = Entry.Selectable->GetSelectionProxyLocalSphereRadius() * ActorTransform.GetScale3D().GetAbsMax();
+}
+
+void URTSSelectableRegistry::UpdateCell(FEntry& Entry)
+{
+	Generation++;
+	ExpandBounds(Entry);
+
+	// Whoever is further behind than twice the registry has more to catch up on than redoing everything costs,
+	// so the older half is dropped rather than letting the log grow with every move
+	MovedSlots.Add(Entry.SlotIndex);
+	MoveCount++;
+	if (MovedSlots.Num() > FMath::Max(Entries.Num() * 2, 64))
+	{
+		MovedSlots.RemoveAt(0, MovedSlots.Num() / 2, false);
+	}
+
+	const FIntPoint NewCell = GetCell(Entry.Center);
+	if (NewCell != Entry.Cell)
+	{
+		RemoveFromCell(Entry.SlotIndex, Entry.Cell);
+		AddToCell(Entry.SlotIndex, NewCell);
+		Entry.Cell = NewCell;
+	}
+}
+
+FIntPoint URTSSelectableRegistry::GetCell(const FVector& Location) const
+{
+	return FIntPoint(
+		FMath::FloorToInt(Location.X / CellSize),
+		FMath::FloorToInt(Location.Y / CellSize)
+	);
+}
+
+void URTSSelectableRegistry::AddToCell(const int32 SlotIndex, const FIntPoint& Cell)
+{
+	Cells.FindOrAdd(Cell).Add(SlotIndex);
+
+	MinOccupiedCell = bHasBounds ? MinOccupiedCell.ComponentMin(Cell) : Cell;
+	MaxOccupiedCell = bHasBounds ? MaxOccupiedCell.ComponentMax(Cell) : Cell;
+}
+
+void URTSSelectableRegistry::RemoveFromCell(const int32 SlotIndex, const FIntPoint& Cell)
+{
+	if (TArray<int32>* SlotIndices = Cells.Find(Cell))
+	{
+		SlotIndices->RemoveSingleSwap(SlotIndex, false);
+
+		if (SlotIndices->Num() == 0)
+		{
+			Cells.Remove(Cell);
+		}
+	}
+}
+
+void URTSSelectableRegistry::ExpandBounds(const FEntry& Entry)
+{
+	const double EntryMinZ = Entry.Center.Z - Entry.SphereRadius;
+	const double EntryMaxZ = Entry.Center.Z + Entry.SphereRadius;
+
+	if (!bHasBounds)
+	{
+		MaxRadius = Entry.SphereRadius;
+		MinZ = EntryMinZ;
+		MaxZ = EntryMaxZ;
+		bHasBounds = true;
+		return;
+	}
+
+	MaxRadius = FMath::Max(MaxRadius, Entry.SphereRadius);
+	MinZ = FMath::Min(MinZ, EntryMinZ);
+	MaxZ = FMath::Max(MaxZ, EntryMaxZ);
+}
@@ -0,0 +1,173 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSSelectionIndicators.h"
+
+#include "RTSSelectable.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Materials/MaterialInterface.h"
+#include "UObject/ConstructorHelpers.h"
+
+ARTSSelectionIndicators::ARTSSelectionIndicators()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PostUpdateWork;
+	SetActorEnableCollision(false);
+
+	this->RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+
+	static ConstructorHelpers::FObjectFinder<UStaticMesh>
+		IndicatorMeshFinder(TEXT("/Engine/BasicShapes/Plane"));
+	this->IndicatorMesh = IndicatorMeshFinder.Object;
+
+	static ConstructorHelpers::FObjectFinder<UMaterialInterface>
+		IndicatorMaterialFinder(TEXT("/OpenRTSCamera/M_UnitSelection"));
+	this->DefaultIndicatorMaterial = IndicatorMaterialFinder.Object;
+}
+
+void ARTSSelectionIndicators::SetRegistry(URTSSelectableRegistry* NewRegistry)
+{
+	this->SelectableRegistry = NewRegistry;
+}
+
+/**
+ * Keeps the indicators under moving selectables, only when something in the registry moved since the last tick.
+ * Also hides the indicators of selectables that went away while hovered or selected.
+ */
+void ARTSSelectionIndicators::Tick(const float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (SelectableRegistry == nullptr || SelectableRegistry->GetGeneration() == LastRegistryGeneration)
+	{
+		return;
+	}
+
+	LastRegistryGeneration = SelectableRegistry->GetGeneration();
+
+	for (auto It = Indicators.CreateIterator(); It; ++It)
+	{
+		if (const URTSSelectable* Selectable = SelectableRegistry->Resolve(It.Key()))
+		{
+			ShowIndicator(Selectable, It.Value());
+		} else
+		{
+			HideIndicator(It.Value());
+			It.RemoveCurrent();
+		}
+	}
+
+	for (TConstSetBitIterator<> It(DirtyBatches); It; ++It)
+	{
+		Batches[It.GetIndex()]->MarkRenderStateDirty();
+	}
+	DirtyBatches.Init(false, Batches.Num());
+}
+
+/**
+ * Shows, updates or hides the indicators of selectables whose selection state changed this frame.
+ * Bound to URTSSelectorSubsystem::OnSelectionStatesChangedDelegate.
+ * @param Selectables
+ */
+void ARTSSelectionIndicators::OnSelectionStatesChanged(const TConstArrayView<URTSSelectable*> Selectables)
+{
+	for (const URTSSelectable* Selectable : Selectables)
+	{
+		const FRTSSelectableHandle& Handle = Selectable->GetSelectableHandle();
+		FIndicatorInstance* Indicator = Indicators.Find(Handle);
+
+		if (Selectable->GetSelectionState() == ESelectionState::None || !Handle.IsSet())
+		{
+			if (Indicator)
+			{
+				HideIndicator(*Indicator);
+				Indicators.Remove(Handle);
+			}
+			continue;
+		}
+
+		if (Indicator == nullptr)
+		{
+			UMaterialInterface* Material = Selectable->IndicatorMaterial
+				? Selectable->IndicatorMaterial.Get()
+				: DefaultIndicatorMaterial.Get();
+
+			FIndicatorInstance NewIndicator;
+			NewIndicator.Batch = FindOrAddBatch(Material);
+			NewIndicator.Instance = FreeInstances[NewIndicator.Batch].Num() > 0
+				? FreeInstances[NewIndicator.Batch].Pop(false)
+				: Batches[NewIndicator.Batch]->AddInstance(FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), true);
+			Indicator = &Indicators.Add(Handle, NewIndicator);
+		}
+
+		ShowIndicator(Selectable, *Indicator);
+	}
+
+	for (TConstSetBitIterator<> It(DirtyBatches); It; ++It)
+	{
+		Batches[It.GetIndex()]->MarkRenderStateDirty();
+	}
+	DirtyBatches.Init(false, Batches.Num());
+}
+
+int32 ARTSSelectionIndicators::FindOrAddBatch(UMaterialInterface* Material)
+{
+	const int32 ExistingBatch = BatchMaterials.Find(Material);
+	if (ExistingBatch != INDEX_NONE)
+	{
+		return ExistingBatch;
+	}
+
+	UInstancedStaticMeshComponent* Batch = NewObject<UInstancedStaticMeshComponent>(this);
+	Batch->SetStaticMesh(IndicatorMesh);
+	Batch->SetMaterial(0, Material);
+	Batch->SetNumCustomDataFloats(2);
+	Batch->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Batch->SetCastShadow(false);
+	Batch->SetupAttachment(RootComponent);
+	Batch->RegisterComponent();
+	AddInstanceComponent(Batch);
+
+	BatchMaterials.Add(Material);
+	FreeInstances.AddDefaulted();
+	DirtyBatches.Add(false);
+	return Batches.Add(Batch);
+}
+
+void ARTSSelectionIndicators::ShowIndicator(const URTSSelectable* Selectable, const FIndicatorInstance& Indicator)
+{
+	float Radius = 0.0f;
+	const FTransform Transform = GetIndicatorTransform(Selectable, Radius);
+
+	UInstancedStaticMeshComponent* Batch = Batches[Indicator.Batch];
+	Batch->UpdateInstanceTransform(Indicator.Instance, Transform, true, false, true);
+	Batch->SetCustomDataValue(Indicator.Instance, 0, static_cast<float>(Selectable->GetSelectionState()), false);
+	Batch->SetCustomDataValue(Indicator.Instance, 1, Radius, false);
+	DirtyBatches[Indicator.Batch] = true;
+}
+
+// Instances are kept for reuse, a zero scale stops them drawing whatever the material does with the custom data
+void ARTSSelectionIndicators::HideIndicator(const FIndicatorInstance& Indicator)
+{
+	UInstancedStaticMeshComponent* Batch = Batches[Indicator.Batch];
+	Batch->UpdateInstanceTransform(Indicator.Instance, FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), true, false, true);
+	Batch->SetCustomDataValue(Indicator.Instance, 0, static_cast<float>(ESelectionState::None), false);
+	FreeInstances[Indicator.Batch].Add(Indicator.Instance);
+	DirtyBatches[Indicator.Batch] = true;
+}
+
+FTransform ARTSSelectionIndicators::GetIndicatorTransform(const URTSSelectable* Selectable, float& OutRadius) const
+{
+	const FBox Bounds = Selectable->GetSelectionProxyWorldBounds();
+	const FVector Center = Bounds.GetCenter();
+	const FVector Extent = Bounds.GetExtent();
+
+	OutRadius = FMath::Max(Extent.X, Extent.Y) * IndicatorRadiusScale;
+	const double Scale = 2.0 * OutRadius / IndicatorMeshSize;
+
+	return FTransform(
+		FQuat::Identity,
+		FVector(Center.X, Center.Y, Bounds.Min.Z + IndicatorHeightOffset),
+		FVector(Scale, Scale, 1.0)
+	);
+}
@@ -0,0 +1,455 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSSelectionKernel.h"
+
+#include "Async/ParallelFor.h"
+#include "CoreGlobals.h"
+#include "Engine/GameViewportClient.h"
+#include "Engine/LocalPlayer.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+#include "SceneView.h"
+
+static TAutoConsoleVariable<int32> CVarRTSSelectionParallelThreshold(
+	TEXT("OpenRTSCamera.Selection.ParallelThreshold"),
+	4096,
+	TEXT("Number of selectables above which the selection kernel splits its work across worker threads."),
+	ECVF_Default
+);
+
+// A multiple of the batch width so that no batch straddles two chunks
+static constexpr int32 SelectionKernelChunkSize = 1024;
+
+bool FRTSSelectionView::Init(const APlayerController* PlayerController)
+{
+	const ULocalPlayer* LocalPlayer = PlayerController ? PlayerController->GetLocalPlayer() : nullptr;
+	if (LocalPlayer == nullptr || LocalPlayer->ViewportClient == nullptr)
+	{
+		return false;
+	}
+
+	FSceneViewProjectionData ProjectionData;
+	if (!LocalPlayer->GetProjectionData(LocalPlayer->ViewportClient->Viewport, ProjectionData))
+	{
+		return false;
+	}
+
+	ViewOrigin = ProjectionData.ViewOrigin;
+	ViewProjection = FMatrix44f(ProjectionData.ViewRotationMatrix * ProjectionData.ProjectionMatrix);
+	ViewRect = ProjectionData.GetConstrainedViewRect();
+	return true;
+}
+
+struct FSelectionProjection
+{
+	explicit FSelectionProjection(const FRTSSelectionView& View)
+		: ViewOrigin(View.ViewOrigin)
+		, M(View.ViewProjection)
+	{
+		HalfWidth = 0.5f * View.ViewRect.Width();
+		HalfHeight = 0.5f * View.ViewRect.Height();
+		ScreenCenterX = View.ViewRect.Min.X + HalfWidth;
+		ScreenCenterY = View.ViewRect.Min.Y + HalfHeight;
+
+		// Clip space w is the distance in front of the camera for perspective views, and always one for orthographic
+		// views, which have nothing behind them to clip
+		const bool bOrthographic = M.M[0][3] == 0.0f && M.M[1][3] == 0.0f && M.M[2][3] == 0.0f;
+		NearW = bOrthographic ? 0.0f : GNearClippingPlane;
+
+		M00 = VectorSetFloat1(M.M[0][0]);
+		M10 = VectorSetFloat1(M.M[1][0]);
+		M20 = VectorSetFloat1(M.M[2][0]);
+		M30 = VectorSetFloat1(M.M[3][0]);
+		M01 = VectorSetFloat1(M.M[0][1]);
+		M11 = VectorSetFloat1(M.M[1][1]);
+		M21 = VectorSetFloat1(M.M[2][1]);
+		M31 = VectorSetFloat1(M.M[3][1]);
+		M03 = VectorSetFloat1(M.M[0][3]);
+		M13 = VectorSetFloat1(M.M[1][3]);
+		M23 = VectorSetFloat1(M.M[2][3]);
+		M33 = VectorSetFloat1(M.M[3][3]);
+
+		VHalfWidth = VectorSetFloat1(HalfWidth);
+		VHalfHeight = VectorSetFloat1(HalfHeight);
+		VScreenCenterX = VectorSetFloat1(ScreenCenterX);
+		VScreenCenterY = VectorSetFloat1(ScreenCenterY);
+		VNearW = VectorSetFloat1(NearW);
+		VSmallNumber = VectorSetFloat1(UE_SMALL_NUMBER);
+	}
+
+	/**
+	 * Projects the four boxes starting at Index to screen boxes.
+	 * OutVisibleMask has a bit per box that isn't entirely behind the near plane, the others have meaningless
+	 * screen boxes. Boxes crossing the near plane are rare, so they're left to ProjectSingle.
+	 */
+	FORCEINLINE void ProjectBatch(
+		const FRTSSelectionBoundsSoA& Bounds,
+		const int32 Index,
+		VectorRegister4Float& OutMinX,
+		VectorRegister4Float& OutMinY,
+		VectorRegister4Float& OutMaxX,
+		VectorRegister4Float& OutMaxY,
+		int32& OutVisibleMask
+	) const
+	{
+		float LocalX[4];
+		float LocalY[4];
+		float LocalZ[4];
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			LocalX[Lane] = static_cast<float>(Bounds.CenterX[Index + Lane] - ViewOrigin.X);
+			LocalY[Lane] = static_cast<float>(Bounds.CenterY[Index + Lane] - ViewOrigin.Y);
+			LocalZ[Lane] = static_cast<float>(Bounds.CenterZ[Index + Lane] - ViewOrigin.Z);
+		}
+
+		const VectorRegister4Float X = VectorLoad(LocalX);
+		const VectorRegister4Float Y = VectorLoad(LocalY);
+		const VectorRegister4Float Z = VectorLoad(LocalZ);
+		const VectorRegister4Float ExtentX = VectorLoad(&Bounds.ExtentX[Index]);
+		const VectorRegister4Float ExtentY = VectorLoad(&Bounds.ExtentY[Index]);
+		const VectorRegister4Float ExtentZ = VectorLoad(&Bounds.ExtentZ[Index]);
+
+		const VectorRegister4Float CenterX = VectorMultiplyAdd(X, M00, VectorMultiplyAdd(Y, M10, VectorMultiplyAdd(Z, M20, M30)));
+		const VectorRegister4Float CenterY = VectorMultiplyAdd(X, M01, VectorMultiplyAdd(Y, M11, VectorMultiplyAdd(Z, M21, M31)));
+		const VectorRegister4Float CenterW = VectorMultiplyAdd(X, M03, VectorMultiplyAdd(Y, M13, VectorMultiplyAdd(Z, M23, M33)));
+
+		// How far each world axis of the box reaches in clip space, corners add or subtract each of them
+		const VectorRegister4Float AxisX[3] = {VectorMultiply(ExtentX, M00), VectorMultiply(ExtentY, M10), VectorMultiply(ExtentZ, M20)};
+		const VectorRegister4Float AxisY[3] = {VectorMultiply(ExtentX, M01), VectorMultiply(ExtentY, M11), VectorMultiply(ExtentZ, M21)};
+		const VectorRegister4Float AxisW[3] = {VectorMultiply(ExtentX, M03), VectorMultiply(ExtentY, M13), VectorMultiply(ExtentZ, M23)};
+
+		const VectorRegister4Float SpreadW = VectorAdd(VectorAbs(AxisW[0]), VectorAdd(VectorAbs(AxisW[1]), VectorAbs(AxisW[2])));
+		const int32 InFrontMask = VectorMaskBits(VectorCompareGE(VectorSubtract(CenterW, SpreadW), VNearW));
+		const int32 BehindMask = VectorMaskBits(VectorCompareLT(VectorAdd(CenterW, SpreadW), VNearW));
+
+		VectorRegister4Float MinNdcX = GlobalVectorConstants::BigNumber;
+		VectorRegister4Float MinNdcY = GlobalVectorConstants::BigNumber;
+		VectorRegister4Float MaxNdcX = VectorNegate(GlobalVectorConstants::BigNumber);
+		VectorRegister4Float MaxNdcY = VectorNegate(GlobalVectorConstants::BigNumber);
+		for (int32 Corner = 0; Corner < 8; Corner++)
+		{
+			VectorRegister4Float CornerX = CenterX;
+			VectorRegister4Float CornerY = CenterY;
+			VectorRegister4Float CornerW = CenterW;
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				if (Corner & (1 << Axis))
+				{
+					CornerX = VectorAdd(CornerX, AxisX[Axis]);
+					CornerY = VectorAdd(CornerY, AxisY[Axis]);
+					CornerW = VectorAdd(CornerW, AxisW[Axis]);
+				} else
+				{
+					CornerX = VectorSubtract(CornerX, AxisX[Axis]);
+					CornerY = VectorSubtract(CornerY, AxisY[Axis]);
+					CornerW = VectorSubtract(CornerW, AxisW[Axis]);
+				}
+			}
+
+			const VectorRegister4Float InvW = VectorDivide(VectorOneFloat(), VectorMax(CornerW, VSmallNumber));
+			const VectorRegister4Float NdcX = VectorMultiply(CornerX, InvW);
+			const VectorRegister4Float NdcY = VectorMultiply(CornerY, InvW);
+			MinNdcX = VectorMin(MinNdcX, NdcX);
+			MinNdcY = VectorMin(MinNdcY, NdcY);
+			MaxNdcX = VectorMax(MaxNdcX, NdcX);
+			MaxNdcY = VectorMax(MaxNdcY, NdcY);
+		}
+
+		// Screen Y runs the other way to clip space Y
+		OutMinX = VectorMultiplyAdd(MinNdcX, VHalfWidth, VScreenCenterX);
+		OutMaxX = VectorMultiplyAdd(MaxNdcX, VHalfWidth, VScreenCenterX);
+		OutMinY = VectorSubtract(VScreenCenterY, VectorMultiply(MaxNdcY, VHalfHeight));
+		OutMaxY = VectorSubtract(VScreenCenterY, VectorMultiply(MinNdcY, VHalfHeight));
+		OutVisibleMask = ~BehindMask & 0xF;
+
+		const int32 StraddleMask = ~(InFrontMask | BehindMask) & 0xF;
+		if (StraddleMask != 0)
+		{
+			float MinX[4];
+			float MinY[4];
+			float MaxX[4];
+			float MaxY[4];
+			VectorStore(OutMinX, MinX);
+			VectorStore(OutMinY, MinY);
+			VectorStore(OutMaxX, MaxX);
+			VectorStore(OutMaxY, MaxY);
+
+			for (int32 Lane = 0; Lane < 4; Lane++)
+			{
+				FBox2f ScreenRect;
+				if ((StraddleMask >> Lane) & 1 && ProjectSingle(Bounds, Index + Lane, ScreenRect))
+				{
+					MinX[Lane] = ScreenRect.Min.X;
+					MinY[Lane] = ScreenRect.Min.Y;
+					MaxX[Lane] = ScreenRect.Max.X;
+					MaxY[Lane] = ScreenRect.Max.Y;
+				}
+			}
+
+			OutMinX = VectorLoad(MinX);
+			OutMinY = VectorLoad(MinY);
+			OutMaxX = VectorLoad(MaxX);
+			OutMaxY = VectorLoad(MaxY);
+		}
+	}
+
+	/**
+	 * Scalar version of ProjectBatch for whatever doesn't fill a batch and for boxes crossing the near plane.
+	 * Those are clipped to the near plane, keeping the corners in front of it and the points where the box's edges
+	 * cross it, so their screen box covers the part that's actually visible.
+	 * @return False when the box is entirely behind the near plane
+	 */
+	bool ProjectSingle(const FRTSSelectionBoundsSoA& Bounds, const int32 Index, FBox2f& OutScreenRect) const
+	{
+		const float X = static_cast<float>(Bounds.CenterX[Index] - ViewOrigin.X);
+		const float Y = static_cast<float>(Bounds.CenterY[Index] - ViewOrigin.Y);
+		const float Z = static_cast<float>(Bounds.CenterZ[Index] - ViewOrigin.Z);
+		const float Extent[3] = {Bounds.ExtentX[Index], Bounds.ExtentY[Index], Bounds.ExtentZ[Index]};
+
+		FVector3f Corners[8];
+		for (int32 Corner = 0; Corner < 8; Corner++)
+		{
+			const float CornerX = X + ((Corner & 1) ? Extent[0] : -Extent[0]);
+			const float CornerY = Y + ((Corner & 2) ? Extent[1] : -Extent[1]);
+			const float CornerZ = Z + ((Corner & 4) ? Extent[2] : -Extent[2]);
+
+			// Clip space x, y and w
+			Corners[Corner] = FVector3f(
+				CornerX * M.M[0][0] + CornerY * M.M[1][0] + CornerZ * M.M[2][0] + M.M[3][0],
+				CornerX * M.M[0][1] + CornerY * M.M[1][1] + CornerZ * M.M[2][1] + M.M[3][1],
+				CornerX * M.M[0][3] + CornerY * M.M[1][3] + CornerZ * M.M[2][3] + M.M[3][3]
+			);
+		}
+
+		float MinNdcX = UE_BIG_NUMBER;
+		float MinNdcY = UE_BIG_NUMBER;
+		float MaxNdcX = -UE_BIG_NUMBER;
+		float MaxNdcY = -UE_BIG_NUMBER;
+		bool bAnyVisible = false;
+
+		const auto AddPoint = [&](const FVector3f& Point)
+		{
+			const float InvW = 1.0f / FMath::Max(Point.Z, UE_SMALL_NUMBER);
+			MinNdcX = FMath::Min(MinNdcX, Point.X * InvW);
+			MinNdcY = FMath::Min(MinNdcY, Point.Y * InvW);
+			MaxNdcX = FMath::Max(MaxNdcX, Point.X * InvW);
+			MaxNdcY = FMath::Max(MaxNdcY, Point.Y * InvW);
+			bAnyVisible = true;
+		};
+
+		for (int32 Corner = 0; Corner < 8; Corner++)
+		{
+			if (Corners[Corner].Z >= NearW)
+			{
+				AddPoint(Corners[Corner]);
+			}
+
+			// Each edge once, from the corner with the axis' bit clear to the one with it set
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				const int32 OtherCorner = Corner | (1 << Axis);
+				if (OtherCorner == Corner)
+				{
+					continue;
+				}
+
+				const FVector3f& From = Corners[Corner];
+				const FVector3f& To = Corners[OtherCorner];
+				if ((From.Z >= NearW) != (To.Z >= NearW))
+				{
+					// Clip space is linear in world space, so interpolating in it finds the exact crossing
+					AddPoint(FMath::Lerp(From, To, (NearW - From.Z) / (To.Z - From.Z)));
+				}
+			}
+		}
+
+		if (!bAnyVisible)
+		{
+			return false;
+		}
+
+		OutScreenRect = FBox2f(
+			FVector2f(ScreenCenterX + MinNdcX * HalfWidth, ScreenCenterY - MaxNdcY * HalfHeight),
+			FVector2f(ScreenCenterX + MaxNdcX * HalfWidth, ScreenCenterY - MinNdcY * HalfHeight)
+		);
+		return true;
+	}
+
+	FVector ViewOrigin;
+	FMatrix44f M;
+	float HalfWidth;
+	float HalfHeight;
+	float ScreenCenterX;
+	float ScreenCenterY;
+	float NearW;
+
+	VectorRegister4Float M00, M10, M20, M30;
+	VectorRegister4Float M01, M11, M21, M31;
+	VectorRegister4Float M03, M13, M23, M33;
+	VectorRegister4Float VHalfWidth;
+	VectorRegister4Float VHalfHeight;
+	VectorRegister4Float VScreenCenterX;
+	VectorRegister4Float VScreenCenterY;
+	VectorRegister4Float VNearW;
+	VectorRegister4Float VSmallNumber;
+};
+
+static void TestRange(
+	const FSelectionProjection& Projection,
+	const FRTSSelectionBoundsSoA& Bounds,
+	const FBox2D& Rect,
+	const int32 Begin,
+	const int32 End,
+	uint8* RESTRICT OutHits
+)
+{
+	const FBox2f RectF(FVector2f(Rect.Min), FVector2f(Rect.Max));
+
+	const VectorRegister4Float VRectMinX = VectorSetFloat1(RectF.Min.X);
+	const VectorRegister4Float VRectMinY = VectorSetFloat1(RectF.Min.Y);
+	const VectorRegister4Float VRectMaxX = VectorSetFloat1(RectF.Max.X);
+	const VectorRegister4Float VRectMaxY = VectorSetFloat1(RectF.Max.Y);
+
+	int32 Index = Begin;
+	for (; Index + 4 <= End; Index += 4)
+	{
+		VectorRegister4Float MinX;
+		VectorRegister4Float MinY;
+		VectorRegister4Float MaxX;
+		VectorRegister4Float MaxY;
+		int32 VisibleMask;
+		Projection.ProjectBatch(Bounds, Index, MinX, MinY, MaxX, MaxY, VisibleMask);
+
+		const VectorRegister4Float OverlapsX = VectorBitwiseAnd(
+			VectorCompareGE(MaxX, VRectMinX),
+			VectorCompareLE(MinX, VRectMaxX)
+		);
+		const VectorRegister4Float OverlapsY = VectorBitwiseAnd(
+			VectorCompareGE(MaxY, VRectMinY),
+			VectorCompareLE(MinY, VRectMaxY)
+		);
+
+		// Anything behind the camera is never selected
+		const int32 Mask = VisibleMask & VectorMaskBits(VectorBitwiseAnd(OverlapsX, OverlapsY));
+		OutHits[Index + 0] = (Mask >> 0) & 1;
+		OutHits[Index + 1] = (Mask >> 1) & 1;
+		OutHits[Index + 2] = (Mask >> 2) & 1;
+		OutHits[Index + 3] = (Mask >> 3) & 1;
+	}
+
+	for (; Index < End; Index++)
+	{
+		FBox2f ScreenRect;
+		OutHits[Index] = Projection.ProjectSingle(Bounds, Index, ScreenRect)
+			&& ScreenRect.Max.X >= RectF.Min.X && ScreenRect.Min.X <= RectF.Max.X
+			&& ScreenRect.Max.Y >= RectF.Min.Y && ScreenRect.Min.Y <= RectF.Max.Y;
+	}
+}
+
+static void ProjectRange(
+	const FSelectionProjection& Projection,
+	const FRTSSelectionBoundsSoA& Bounds,
+	const int32 Begin,
+	const int32 End,
+	FBox2f* RESTRICT OutScreenRects
+)
+{
+	int32 Index = Begin;
+	for (; Index + 4 <= End; Index += 4)
+	{
+		VectorRegister4Float VMinX;
+		VectorRegister4Float VMinY;
+		VectorRegister4Float VMaxX;
+		VectorRegister4Float VMaxY;
+		int32 VisibleMask;
+		Projection.ProjectBatch(Bounds, Index, VMinX, VMinY, VMaxX, VMaxY, VisibleMask);
+
+		float MinX[4];
+		float MinY[4];
+		float MaxX[4];
+		float MaxY[4];
+		VectorStore(VMinX, MinX);
+		VectorStore(VMinY, MinY);
+		VectorStore(VMaxX, MaxX);
+		VectorStore(VMaxY, MaxY);
+
+		for (int32 Lane = 0; Lane < 4; Lane++)
+		{
+			OutScreenRects[Index + Lane] = (VisibleMask >> Lane) & 1
+				? FBox2f(FVector2f(MinX[Lane], MinY[Lane]), FVector2f(MaxX[Lane], MaxY[Lane]))
+				: FBox2f(ForceInit);
+		}
+	}
+
+	for (; Index < End; Index++)
+	{
+		FBox2f ScreenRect;
+		OutScreenRects[Index] = Projection.ProjectSingle(Bounds, Index, ScreenRect) ? ScreenRect : FBox2f(ForceInit);
+	}
+}
+
+/**
+ * Runs Body over the bounds in chunks, across worker threads when there are enough of them
+ */
+template <typename FunctionType>
+static void ForEachChunk(const int32 Num, FunctionType&& Body)
+{
+	const int32 NumChunks = FMath::DivideAndRoundUp(Num, SelectionKernelChunkSize);
+	const bool bParallel = NumChunks > 1 && Num > CVarRTSSelectionParallelThreshold.GetValueOnGameThread();
+
+	ParallelFor(
+		NumChunks,
+		[Num, &Body](const int32 ChunkIndex)
+		{
+			const int32 Begin = ChunkIndex * SelectionKernelChunkSize;
+			const int32 End = FMath::Min(Begin + SelectionKernelChunkSize, Num);
+			Body(Begin, End);
+		},
+		bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread
+	);
+}
+
+void FRTSSelectionKernel::TestRect(
+	const FRTSSelectionView& View,
+	const FRTSSelectionBoundsSoA& Bounds,
+	const FBox2D& Rect,
+	TArray<uint8>& OutHits
+)
+{
+	const int32 Num = Bounds.Num();
+	OutHits.SetNumUninitialized(Num, false);
+
+	if (Num == 0)
+	{
+		return;
+	}
+
+	const FSelectionProjection Projection(View);
+	uint8* Hits = OutHits.GetData();
+	ForEachChunk(Num, [&Projection, &Bounds, &Rect, Hits](const int32 Begin, const int32 End)
+	{
+		TestRange(Projection, Bounds, Rect, Begin, End, Hits);
+	});
+}
+
+void FRTSSelectionKernel::ProjectToScreen(
+	const FRTSSelectionView& View,
+	const FRTSSelectionBoundsSoA& Bounds,
+	TArray<FBox2f>& OutScreenRects
+)
+{
+	const int32 Num = Bounds.Num();
+	OutScreenRects.SetNumUninitialized(Num, false);
+
+	if (Num == 0)
+	{
+		return;
+	}
+
+	const FSelectionProjection Projection(View);
+	FBox2f* ScreenRects = OutScreenRects.GetData();
+	ForEachChunk(Num, [&Projection, &Bounds, ScreenRects](const int32 Begin, const int32 End)
+	{
+		ProjectRange(Projection, Bounds, Begin, End, ScreenRects);
+	});
+}
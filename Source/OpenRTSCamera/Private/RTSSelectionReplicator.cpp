@@ -0,0 +1,337 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSSelectionReplicator.h"
+
+#include "RTSSelectorSubsystem.h"
+#include "Engine/NetConnection.h"
+#include "GameFramework/PlayerController.h"
+#include "UObject/CoreNet.h"
+
+namespace RTSSelectionReplication
+{
+	// Sequence, reset bit and both packed counts at their largest
+	constexpr int32 DeltaHeaderBytes = 7;
+
+	// Guards the server against a malicious count, far more than a capped update can carry
+	constexpr uint32 MaxActorsPerDelta = 4096;
+
+	static bool SerializeActors(FArchive& Ar, UPackageMap* Map, TArray<TObjectPtr<AActor>>& Actors)
+	{
+		uint32 NumActors = Actors.Num();
+		Ar.SerializeIntPacked(NumActors);
+
+		if (Ar.IsLoading())
+		{
+			if (NumActors > MaxActorsPerDelta)
+			{
+				Ar.SetError();
+				return false;
+			}
+			Actors.SetNum(NumActors);
+		}
+
+		bool bSuccess = true;
+		for (TObjectPtr<AActor>& Actor : Actors)
+		{
+			UObject* Object = Actor;
+			bSuccess &= Map->SerializeObject(Ar, AActor::StaticClass(), Object);
+			Actor = Cast<AActor>(Object);
+		}
+		return bSuccess;
+	}
+}
+
+bool FRTSSelectionDelta::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar << Sequence;
+
+	uint8 ResetBit = bReset ? 1 : 0;
+	Ar.SerializeBits(&ResetBit, 1);
+	bReset = ResetBit != 0;
+
+	bOutSuccess = RTSSelectionReplication::SerializeActors(Ar, Map, Added);
+	bOutSuccess &= RTSSelectionReplication::SerializeActors(Ar, Map, Removed);
+	return true;
+}
+
+URTSSelectionReplicator::URTSSelectionReplicator()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = true;
+	SetIsReplicatedByDefault(true);
+}
+
+void URTSSelectionReplicator::BeginPlay()
+{
+	Super::BeginPlay();
+
+	SelectableRegistry = GetWorld()->GetSubsystem<URTSSelectableRegistry>();
+
+	// Only the owning client has a selection to send
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		SetComponentTickEnabled(false);
+	}
+}
+
+void URTSSelectionReplicator::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (SelectorSubsystem)
+	{
+		SelectorSubsystem->OnSelectionChangedDelegate.Remove(SelectionChangedHandle);
+		SelectorSubsystem = nullptr;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void URTSSelectionReplicator::TickComponent(
+	const float DeltaTime,
+	const ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction
+)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// The local player is only set on the controller some time after it begins play on clients
+	if (SelectorSubsystem == nullptr)
+	{
+		const APlayerController* PlayerController = Cast<APlayerController>(GetOwner());
+		if (PlayerController == nullptr || !PlayerController->IsLocalController() || PlayerController->GetLocalPlayer() == nullptr)
+		{
+			return;
+		}
+
+		SelectorSubsystem = URTSSelectorSubsystem::Get(PlayerController);
+		SelectionChangedHandle = SelectorSubsystem->OnSelectionChangedDelegate.AddUObject(
+			this,
+			&URTSSelectionReplicator::OnSelectionChanged
+		);
+		QueueResync();
+	}
+
+	TimeSinceLastSend += DeltaTime;
+	SendPendingUpdate();
+}
+
+TArray<AActor*> URTSSelectionReplicator::GetReplicatedSelection() const
+{
+	TArray<AActor*> Actors;
+	Actors.Reserve(ReplicatedSelection.Num());
+	for (const TObjectKey<AActor>& Actor : ReplicatedSelection)
+	{
+		if (AActor* ResolvedActor = Actor.ResolveObjectPtr())
+		{
+			Actors.Add(ResolvedActor);
+		}
+	}
+	return Actors;
+}
+
+bool URTSSelectionReplicator::IsReplicatedSelected(const AActor* Actor) const
+{
+	return Actor && ReplicatedSelection.Contains(Actor);
+}
+
+/**
+ * Applies an update from the client. Updates have to arrive in sequence, anything after a gap is dropped and the
+ * client is asked for its whole selection, which arrives as a reset followed by normal updates.
+ * @param Delta
+ */
+void URTSSelectionReplicator::ServerUpdateSelection_Implementation(const FRTSSelectionDelta& Delta)
+{
+	const int16 SequenceOffset = static_cast<int16>(Delta.Sequence - ExpectedSequence);
+
+	if (Delta.bReset)
+	{
+		// Reordered behind a newer update, the selection it starts has already been replaced
+		if (!bAwaitingResync && SequenceOffset < 0)
+		{
+			return;
+		}
+
+		ReplicatedSelection.Reset();
+		bAwaitingResync = false;
+	} else if (bAwaitingResync)
+	{
+		RequestResync();
+		return;
+	} else if (SequenceOffset < 0)
+	{
+		// Late duplicate of something already applied or already covered by a resync
+		return;
+	} else if (SequenceOffset > 0)
+	{
+		bAwaitingResync = true;
+		RequestResync();
+		return;
+	}
+
+	ExpectedSequence = Delta.Sequence + 1;
+
+	// The client can't send removals for actors that no longer exist, so those are forgotten here instead
+	for (auto It = ReplicatedSelection.CreateIterator(); It; ++It)
+	{
+		if (It->ResolveObjectPtr() == nullptr)
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	for (const TObjectPtr<AActor>& Actor : Delta.Removed)
+	{
+		ReplicatedSelection.Remove(Actor.Get());
+	}
+
+	for (const TObjectPtr<AActor>& Actor : Delta.Added)
+	{
+		if (Actor)
+		{
+			ReplicatedSelection.Add(Actor.Get());
+		}
+	}
+
+	if (OnReplicatedSelectionChangedDelegate.IsBound() && (Delta.bReset || Delta.Added.Num() > 0 || Delta.Removed.Num() > 0))
+	{
+		OnReplicatedSelectionChangedDelegate.Broadcast();
+	}
+}
+
+void URTSSelectionReplicator::ClientRequestSelectionResync_Implementation()
+{
+	if (SelectorSubsystem)
+	{
+		QueueResync();
+	}
+}
+
+/**
+ * Folds a selection change into the pending update, a change that undoes one not yet sent cancels it out
+ * @param Added
+ * @param Removed
+ */
+void URTSSelectionReplicator::OnSelectionChanged(
+	const TConstArrayView<FRTSSelectableHandle> Added,
+	const TConstArrayView<FRTSSelectableHandle> Removed
+)
+{
+	for (const FRTSSelectableHandle& Handle : Added)
+	{
+		AActor* Actor = SelectableRegistry->ResolveActor(Handle);
+		if (Actor && Actor->GetIsReplicated() && PendingRemoved.Remove(Actor) == 0)
+		{
+			PendingAdded.Add(Actor);
+		}
+	}
+
+	for (const FRTSSelectableHandle& Handle : Removed)
+	{
+		AActor* Actor = SelectableRegistry->ResolveActor(Handle);
+		if (Actor && Actor->GetIsReplicated() && PendingAdded.Remove(Actor) == 0)
+		{
+			PendingRemoved.Add(Actor);
+		}
+	}
+}
+
+// Replaces whatever is pending with the whole selection, sent as a reset
+void URTSSelectionReplicator::QueueResync()
+{
+	PendingAdded.Reset();
+	PendingRemoved.Reset();
+	bPendingReset = true;
+
+	for (const FRTSSelectableHandle& Handle : SelectorSubsystem->GetSelectedHandles())
+	{
+		AActor* Actor = SelectableRegistry->ResolveActor(Handle);
+		if (Actor && Actor->GetIsReplicated())
+		{
+			PendingAdded.Add(Actor);
+		}
+	}
+}
+
+/**
+ * Sends as much of the pending update as fits in MaxBytesPerUpdate, the rest goes in the following ticks.
+ * Each actor is measured by writing it through the connection's package map, which is what the update itself does,
+ * so actors whose path goes along with their GUID the first time count for what they really take. At least one
+ * actor is always sent, however big, so a large one can't hold the rest back.
+ * When nothing changed an empty update is sent every HeartbeatInterval to keep the sequence moving.
+ */
+void URTSSelectionReplicator::SendPendingUpdate()
+{
+	const bool bHasChanges = bPendingReset || PendingAdded.Num() > 0 || PendingRemoved.Num() > 0;
+	if (!bHasChanges && TimeSinceLastSend < HeartbeatInterval)
+	{
+		return;
+	}
+
+	FRTSSelectionDelta Delta;
+	Delta.Sequence = NextSequence++;
+	Delta.bReset = bPendingReset;
+	bPendingReset = false;
+
+	// Without a connection the update runs locally on a listen server, so there's nothing to cap
+	const UNetConnection* Connection = GetOwner()->GetNetConnection();
+	UPackageMap* PackageMap = Connection ? Connection->PackageMap : nullptr;
+	FNetBitWriter SizeWriter(PackageMap, 0);
+	const int64 MaxActorBits = int64(MaxBytesPerUpdate - RTSSelectionReplication::DeltaHeaderBytes) * 8;
+
+	const auto FitsInUpdate = [PackageMap, &SizeWriter, &Delta, MaxActorBits](AActor* Actor)
+	{
+		if (PackageMap == nullptr)
+		{
+			return true;
+		}
+
+		UObject* Object = Actor;
+		PackageMap->SerializeObject(SizeWriter, AActor::StaticClass(), Object);
+		return SizeWriter.GetNumBits() <= MaxActorBits || Delta.Added.Num() + Delta.Removed.Num() == 0;
+	};
+
+	// Removals of actors that are already gone are dropped, the server forgets those by itself
+	bool bIsFull = false;
+	for (auto It = PendingRemoved.CreateIterator(); It && !bIsFull; ++It)
+	{
+		if (AActor* Actor = It->Get())
+		{
+			bIsFull = !FitsInUpdate(Actor);
+			if (bIsFull)
+			{
+				break;
+			}
+			Delta.Removed.Add(Actor);
+		}
+		It.RemoveCurrent();
+	}
+
+	for (auto It = PendingAdded.CreateIterator(); It && !bIsFull; ++It)
+	{
+		if (AActor* Actor = It->Get())
+		{
+			bIsFull = !FitsInUpdate(Actor);
+			if (bIsFull)
+			{
+				break;
+			}
+			Delta.Added.Add(Actor);
+		}
+		It.RemoveCurrent();
+	}
+
+	ServerUpdateSelection(Delta);
+	TimeSinceLastSend = 0.0f;
+}
+
+// Asks the client for its whole selection, at most once every ResyncRetryInterval in case the reset is lost too
+void URTSSelectionReplicator::RequestResync()
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	if (Now - LastResyncRequestTime < ResyncRetryInterval)
+	{
+		return;
+	}
+
+	LastResyncRequestTime = Now;
+	ClientRequestSelectionResync();
+}
@@ -4,6 +4,19 @@
 
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+
+static TAutoConsoleVariable<bool> CVarRTSSelectionResolveAfterActorTick(
+	TEXT("OpenRTSCamera.Selection.ResolveAfterActorTick"),
+	true,
+	TEXT("Resolve the final selection once actors have ticked in the frame of the input that completes it, so it sees\n")
+	TEXT("where units moved that frame, instead of on the next HUD draw.\n")
+	TEXT("Needs the selection kernel query mode, other modes always wait for the HUD."),
+	ECVF_Default
+);
 
 URTSSelectorSubsystem::URTSSelectorSubsystem()
 {
@@ -36,10 +49,18 @@ URTSSelectorSubsystem::URTSSelectorSubsystem()
 void URTSSelectorSubsystem::RegisterPlayerController(APlayerController* NewPlayerController)
 {
 	this->PlayerController = NewPlayerController;
+	this->SelectableRegistry = NewPlayerController->GetWorld()->GetSubsystem<URTSSelectableRegistry>();
 	this->HUD = Cast<ARTSHUD>(NewPlayerController->GetHUD());
 	this->HUD->SetPlayerController(NewPlayerController);
-	this->HUD->OnSelectedActorsDelegate.AddUObject(this, &URTSSelectorSubsystem::ProcessSelectedActors);
-	this->HUD->OnHoveredActorsDelegate.AddUObject(this, &URTSSelectorSubsystem::ProcessHoveredActors);
+	this->HUD->OnSelectedHandlesDelegate.AddUObject(this, &URTSSelectorSubsystem::ProcessSelectedHandles);
+	this->HUD->OnHoveredHandlesDelegate.AddUObject(this, &URTSSelectorSubsystem::ProcessHoveredHandles);
+	this->HUD->OnHoveredHandlesDeltaDelegate.AddUObject(this, &URTSSelectorSubsystem::ProcessHoveredHandlesDelta);
+
+	if (SelectableRegistry)
+	{
+		SelectableRegistry->OnSelectableUnregistered.RemoveAll(this);
+		SelectableRegistry->OnSelectableUnregistered.AddUObject(this, &URTSSelectorSubsystem::OnSelectableUnregistered);
+	}
 	
 	BindInputActions();
 	BindInputMappingContext();
@@ -56,80 +77,455 @@ void URTSSelectorSubsystem::RegisterPlayerController(APlayerController* NewPlaye
 // }
 
 /**
- * Processes the selected actors from the HUD, adding/removing them from the selection
- * Sends all selected/deselected rather than just the newly selected/deselected this
- * implies doing a full refresh of any UI that takes this info
+ * Processes selected actors, e.g. from a Blueprint HUD, see ProcessSelectedHandles
  * @param NewSelectedActors 
  */
 void URTSSelectorSubsystem::ProcessSelectedActors(const TArray<AActor*>& NewSelectedActors)
-{	
-	TArray<URTSSelectable*> InputSelectables;
-	GetSelectablesFromActors(NewSelectedActors, InputSelectables);
+{
+	TArray<FRTSSelectableHandle>& InputHandles = InputHandlesBuffer;
+	InputHandles.Reset();
+	GetHandlesFromActors(NewSelectedActors, InputHandles);
+
+	ProcessSelectedHandles(InputHandles);
+}
 
+/**
+ * Processes the selected selectables from the HUD, adding/removing them from the selection
+ * Only units whose selection state actually changes are selected/deselected and broadcast,
+ * units that stay selected are left untouched
+ * @param NewSelectedHandles 
+ */
+void URTSSelectorSubsystem::ProcessSelectedHandles(const TConstArrayView<FRTSSelectableHandle> NewSelectedHandles)
+{
 	// Unhover all as selection has happened
 	UnhoverActors();
 	
 	// If it's a deselect, clear the selection and return
-	if(InputSelectables.Num() == 0)
+	if(NewSelectedHandles.Num() == 0)
 	{
 		DeselectActors();
 		return;
 	}
 
-	const TArray<URTSSelectable*> CurrentlySelected = SelectedSet.Array();
-	TArray<URTSSelectable*> Selected;
-	TArray<URTSSelectable*> Deselected;
-	
-	// If shift is held, it's an append to selection otherwise, clear current selection and select new actors
-	if(bShiftDown)
+	// Clicking the same unit twice in quick succession selects all of its type on screen, proxies have no type
+	if(bSingleSelect)
 	{
-		if(InputSelectables.Num() == 1)
+		const double Now = PlayerController->GetWorld()->GetRealTimeSeconds();
+		const FRTSSelectableHandle ClickedHandle = FindClosestToCursor(NewSelectedHandles);
+		const bool bDoubleClick = ClickedHandle == LastClickedHandle && Now - LastClickTime <= DoubleClickTime;
+
+		// A third click starts over rather than counting as another double click
+		LastClickedHandle = bDoubleClick ? FRTSSelectableHandle() : ClickedHandle;
+		LastClickTime = Now;
+		
+		const AActor* ClickedActor = SelectableRegistry->ResolveActor(ClickedHandle);
+		if(bDoubleClick && ClickedActor)
 		{
-			URTSSelectable* NewSelectable = InputSelectables[0];
+			TArray<FRTSSelectableHandle>& OfClass = QueryHandlesBuffer;
+			OfClass.Reset();
+			GatherOfClassOnScreen(ClickedActor->GetClass(), OfClass);
+			SetSelection(OfClass, bShiftDown);
+			return;
+		}
+	}
 
-			// If it's already selected, deselect, otherwise select
-			if(CurrentlySelected.Contains(NewSelectable))
-			{
-				Selected = CurrentlySelected;
-				Selected.Remove(NewSelectable);
+	// If shift is held on a single unit it's a toggle, otherwise it's either an append to the selection
+	// or a replacement of it
+	if(bShiftDown && NewSelectedHandles.Num() == 1)
+	{
+		const FRTSSelectableHandle& NewHandle = NewSelectedHandles[0];
+
+		TArray<FRTSSelectableHandle>& Selected = SelectedBuffer;
+		TArray<FRTSSelectableHandle>& Deselected = DeselectedBuffer;
+		Selected.Reset();
+		Deselected.Reset();
+
+		// If it's already selected, deselect, otherwise select
+		if(SelectedHandles.Contains(NewHandle))
+		{
+			Deselected.Add(NewHandle);
+		} else
+		{
+			Selected.Add(NewHandle);
+		}
+		
+		ChangeSelection(Selected, Deselected);
+	} else
+	{
+		SetSelection(NewSelectedHandles, bShiftDown);
+	}
+}
 
-				Deselected.Add(NewSelectable);
-			} else
+/**
+ * Replaces the selection with the given selectables, or appends them to it, diffing against the current selection
+ * so only units whose state changes are selected/deselected. Linear in the input and the selection.
+ * @param NewHandles 
+ * @param bAppend 
+ */
+void URTSSelectorSubsystem::SetSelection(const TConstArrayView<FRTSSelectableHandle> NewHandles, const bool bAppend)
+{
+	TArray<FRTSSelectableHandle>& Selected = SelectedBuffer;
+	TArray<FRTSSelectableHandle>& Deselected = DeselectedBuffer;
+	Selected.Reset();
+	Deselected.Reset();
+	
+	FRTSSelectableHandleSet& InputSet = InputSetBuffer;
+	InputSet.Reset();
+	
+	for(const FRTSSelectableHandle& Handle : NewHandles)
+	{
+		if(SelectableRegistry->IsValid(Handle) && InputSet.Add(Handle) && !SelectedHandles.Contains(Handle))
+		{
+			Selected.Add(Handle);
+		}
+	}
+	
+	if(!bAppend)
+	{
+		for(const auto& Handle : SelectedHandles)
+		{
+			if(!InputSet.Contains(Handle))
 			{
-				Selected = CurrentlySelected;
-				Selected.Add(NewSelectable);
+				Deselected.Add(Handle);
 			}
 		}
+	}
+	
+	ChangeSelection(Selected, Deselected);
+}
+
+void URTSSelectorSubsystem::SelectAllOfTypeOnScreen(const AActor* Actor, const bool bAppend)
+{
+	if (Actor == nullptr)
+	{
+		return;
+	}
+
+	TArray<FRTSSelectableHandle>& OfClass = QueryHandlesBuffer;
+	OfClass.Reset();
+	GatherOfClassOnScreen(Actor->GetClass(), OfClass);
+	SetSelection(OfClass, bAppend);
+}
+
+/**
+ * Gathers the selectables of the class from the registry's class bucket, keeping those whose selection proxy
+ * projects onto the viewport. Only selectables of the class are ever looked at.
+ * @param Class 
+ * @param OutHandles Appended to
+ */
+void URTSSelectorSubsystem::GatherOfClassOnScreen(const UClass* Class, TArray<FRTSSelectableHandle>& OutHandles)
+{
+	FRTSSelectionView View;
+	if (!SelectableRegistry || !View.Init(PlayerController))
+	{
+		return;
+	}
+
+	const int32 FirstCandidate = OutHandles.Num();
+	SelectableRegistry->GatherOfClass(Class, OutHandles);
+	const TConstArrayView<FRTSSelectableHandle> Candidates(OutHandles.GetData() + FirstCandidate, OutHandles.Num() - FirstCandidate);
+	SelectableRegistry->PackBounds(Candidates, QueryBoundsBuffer);
+
+	const FBox2D ViewRect(FVector2D(View.ViewRect.Min), FVector2D(View.ViewRect.Max));
+	FRTSSelectionKernel::TestRect(View, QueryBoundsBuffer, ViewRect, QueryHitsBuffer);
+
+	int32 NumKept = FirstCandidate;
+	for (int32 Index = 0; Index < QueryHitsBuffer.Num(); Index++)
+	{
+		if (QueryHitsBuffer[Index])
+		{
+			OutHandles[NumKept++] = OutHandles[FirstCandidate + Index];
+		}
+	}
+	OutHandles.SetNum(NumKept, false);
+}
+
+static URTSSelectableRegistry* FindSelectableRegistry(const UObject* WorldContextObject)
+{
+	const UWorld* World = GEngine->GetWorldFromContextObject(WorldContextObject, EGetWorldErrorMode::LogAndReturnNull);
+	return World ? World->GetSubsystem<URTSSelectableRegistry>() : nullptr;
+}
+
+// Proxies have no actor and are left out, so Blueprints never get None entries
+static TArray<AActor*> ResolveQueryActors(const UObject* WorldContextObject, const TArray<FRTSSelectableHandle>& Handles)
+{
+	TArray<AActor*> Actors;
+	const URTSSelectableRegistry* Registry = FindSelectableRegistry(WorldContextObject);
+	if (Registry == nullptr)
+	{
+		return Actors;
+	}
+
+	Actors.Reserve(Handles.Num());
+	for (const FRTSSelectableHandle& Handle : Handles)
+	{
+		if (AActor* Actor = Registry->ResolveActor(Handle))
+		{
+			Actors.Add(Actor);
+		}
+	}
+	return Actors;
+}
+
+TArray<AActor*> URTSSelectorSubsystem::GetSelectablesInCircle(
+	const UObject* WorldContextObject,
+	const FVector Center,
+	const float Radius
+)
+{
+	TArray<FRTSSelectableHandle> Handles;
+	GetSelectableHandlesInCircle(WorldContextObject, Center, Radius, Handles);
+	return ResolveQueryActors(WorldContextObject, Handles);
+}
+
+TArray<AActor*> URTSSelectorSubsystem::GetSelectablesInConvexPolygon(
+	const UObject* WorldContextObject,
+	const TArray<FVector2D>& Polygon
+)
+{
+	TArray<FRTSSelectableHandle> Handles;
+	GetSelectableHandlesInConvexPolygon(WorldContextObject, Polygon, Handles);
+	return ResolveQueryActors(WorldContextObject, Handles);
+}
+
+TArray<AActor*> URTSSelectorSubsystem::GetSelectablesInViewRectOnGround(
+	const UObject* WorldContextObject,
+	const FMinimalViewInfo& ViewInfo,
+	const FIntPoint ViewportSize,
+	const FVector2D FirstPoint,
+	const FVector2D SecondPoint
+)
+{
+	TArray<FRTSSelectableHandle> Handles;
+	GetSelectableHandlesInViewRectOnGround(WorldContextObject, ViewInfo, ViewportSize, FirstPoint, SecondPoint, Handles);
+	return ResolveQueryActors(WorldContextObject, Handles);
+}
+
+void URTSSelectorSubsystem::GetSelectableHandlesInCircle(
+	const UObject* WorldContextObject,
+	const FVector& Center,
+	const float Radius,
+	TArray<FRTSSelectableHandle>& OutHandles
+)
+{
+	if (const URTSSelectableRegistry* Registry = FindSelectableRegistry(WorldContextObject))
+	{
+		Registry->GatherInCircle(FVector2D(Center), Radius, OutHandles);
+	}
+}
 
-		if(InputSelectables.Num() > 1)
+void URTSSelectorSubsystem::GetSelectableHandlesInConvexPolygon(
+	const UObject* WorldContextObject,
+	const TConstArrayView<FVector2D> Polygon,
+	TArray<FRTSSelectableHandle>& OutHandles
+)
+{
+	if (const URTSSelectableRegistry* Registry = FindSelectableRegistry(WorldContextObject))
+	{
+		Registry->GatherInConvexPolygon(Polygon, OutHandles);
+	}
+}
+
+void URTSSelectorSubsystem::GetSelectableHandlesInViewRectOnGround(
+	const UObject* WorldContextObject,
+	const FMinimalViewInfo& ViewInfo,
+	const FIntPoint& ViewportSize,
+	const FVector2D& FirstPoint,
+	const FVector2D& SecondPoint,
+	TArray<FRTSSelectableHandle>& OutHandles
+)
+{
+	const URTSSelectableRegistry* Registry = FindSelectableRegistry(WorldContextObject);
+	TArray<FVector2D> Polygon;
+	if (Registry && Registry->GetViewRectGroundPolygon(ViewInfo, ViewportSize, FirstPoint, SecondPoint, Polygon))
+	{
+		Registry->GatherInConvexPolygon(Polygon, OutHandles);
+	}
+}
+
+void URTSSelectorSubsystem::StoreControlGroup(const int32 GroupIndex)
+{
+	if (FRTSSelectableHandleSet* Group = GetControlGroup(GroupIndex))
+	{
+		Group->Reset();
+		AddToControlGroup(GroupIndex);
+	}
+}
+
+void URTSSelectorSubsystem::AddToControlGroup(const int32 GroupIndex)
+{
+	FRTSSelectableHandleSet* Group = GetControlGroup(GroupIndex);
+	if (Group == nullptr)
+	{
+		return;
+	}
+
+	for (const FRTSSelectableHandle& Handle : SelectedHandles)
+	{
+		Group->Add(Handle);
+
+		if (bControlGroupsSteal)
 		{
-			Selected = CurrentlySelected;
-			for(const auto& Selectable : InputSelectables)
+			for (int32 OtherIndex = 0; OtherIndex < NumControlGroups; OtherIndex++)
 			{
-				if(!CurrentlySelected.Contains(Selectable))
+				if (OtherIndex != GroupIndex)
 				{
-					Selected.Add(Selectable);
+					ControlGroups[OtherIndex].Remove(Handle);
 				}
 			}
 		}
-	} else
+	}
+}
+
+void URTSSelectorSubsystem::RecallControlGroup(const int32 GroupIndex, const bool bAppend)
+{
+	FRTSSelectableHandleSet* Group = GetControlGroup(GroupIndex);
+	if (Group == nullptr)
 	{
-		Selected = InputSelectables;
-		Deselected = CurrentlySelected;
+		return;
+	}
+
+	SetSelection(Group->GetHandles(), bAppend);
+}
+
+TArray<AActor*> URTSSelectorSubsystem::GetControlGroupActors(const int32 GroupIndex)
+{
+	TArray<AActor*> Actors;
+	if (const FRTSSelectableHandleSet* Group = GetControlGroup(GroupIndex))
+	{
+		Actors.Reserve(Group->Num());
+		for (const FRTSSelectableHandle& Handle : *Group)
+		{
+			if (AActor* Actor = SelectableRegistry->ResolveActor(Handle))
+			{
+				Actors.Add(Actor);
+			}
+		}
+	}
+	return Actors;
+}
+
+/**
+ * Gets the control group, first pruning units that unregistered since it was last used
+ * @param GroupIndex 
+ */
+FRTSSelectableHandleSet* URTSSelectorSubsystem::GetControlGroup(const int32 GroupIndex)
+{
+	if (GroupIndex < 0 || GroupIndex >= NumControlGroups || !SelectableRegistry)
+	{
+		return nullptr;
+	}
+
+	FRTSSelectableHandleSet& Group = ControlGroups[GroupIndex];
+	for (int32 Index = Group.Num() - 1; Index >= 0; Index--)
+	{
+		const FRTSSelectableHandle Handle = Group.GetHandles()[Index];
+		if (!SelectableRegistry->IsValid(Handle))
+		{
+			Group.Remove(Handle);
+		}
 	}
 	
-	DeselectActors(Deselected);
-	SelectActors(Selected);
+	return &Group;
 }
 
+// Processes hovered actors, e.g. from a Blueprint HUD, see ProcessHoveredHandles
 void URTSSelectorSubsystem::ProcessHoveredActors(const TArray<AActor*>& NewHoveredActors)
 {
-	TArray<URTSSelectable*> NewSelectables;
-	GetSelectablesFromActors(NewHoveredActors, NewSelectables);
+	TArray<FRTSSelectableHandle>& InputHandles = InputHandlesBuffer;
+	InputHandles.Reset();
+	GetHandlesFromActors(NewHoveredActors, InputHandles);
+
+	ProcessHoveredHandles(InputHandles);
+}
+
+/**
+ * Processes the hovered selectables from the HUD, diffing them against the current hover
+ * Only units that entered or left the hover get HoverStart/HoverEnd and are broadcast,
+ * units that stay hovered between frames are left untouched
+ * @param NewHoveredHandles 
+ */
+void URTSSelectorSubsystem::ProcessHoveredHandles(const TConstArrayView<FRTSSelectableHandle> NewHoveredHandles)
+{
+	FRTSSelectableHandleSet& NewHoveredSet = InputSetBuffer;
+	NewHoveredSet.Reset();
+
+	TArray<FRTSSelectableHandle>& HoverStarted = SelectedBuffer;
+	HoverStarted.Reset();
+	for (const FRTSSelectableHandle& Handle : NewHoveredHandles)
+	{
+		if (SelectableRegistry->IsValid(Handle) && NewHoveredSet.Add(Handle) && !HoveredHandles.Contains(Handle))
+		{
+			HoverStarted.Add(Handle);
+		}
+	}
+
+	TArray<FRTSSelectableHandle>& HoverEnded = DeselectedBuffer;
+	HoverEnded.Reset();
+	for (const auto& Handle : HoveredHandles)
+	{
+		if (!NewHoveredSet.Contains(Handle))
+		{
+			HoverEnded.Add(Handle);
+		}
+	}
 	
-	UnhoverActors();
+	ChangeHover(HoverStarted, HoverEnded);
+}
 
-	HoverActors(NewSelectables);
+/**
+ * Processes a change in hover given as the actors that entered and left the selection box, see
+ * ProcessHoveredHandlesDelta
+ * @param HoverStartedActors 
+ * @param HoverEndedActors 
+ */
+void URTSSelectorSubsystem::ProcessHoveredActorsDelta(
+	const TArray<AActor*>& HoverStartedActors,
+	const TArray<AActor*>& HoverEndedActors
+)
+{
+	TArray<FRTSSelectableHandle>& InputHandles = InputHandlesBuffer;
+	InputHandles.Reset();
+	GetHandlesFromActors(HoverStartedActors, InputHandles);
+	const int32 NumStarted = InputHandles.Num();
+	GetHandlesFromActors(HoverEndedActors, InputHandles);
+
+	const TConstArrayView<FRTSSelectableHandle> Handles(InputHandles);
+	ProcessHoveredHandlesDelta(Handles.Slice(0, NumStarted), Handles.Slice(NumStarted, Handles.Num() - NumStarted));
+}
+
+/**
+ * Processes a change in hover from the HUD given as the selectables that entered and left the selection box,
+ * so the cost follows the size of the change rather than the size of the hover
+ * @param HoverStartedHandles 
+ * @param HoverEndedHandles 
+ */
+void URTSSelectorSubsystem::ProcessHoveredHandlesDelta(
+	const TConstArrayView<FRTSSelectableHandle> HoverStartedHandles,
+	const TConstArrayView<FRTSSelectableHandle> HoverEndedHandles
+)
+{
+	TArray<FRTSSelectableHandle>& HoverEnded = DeselectedBuffer;
+	HoverEnded.Reset();
+	for (const FRTSSelectableHandle& Handle : HoverEndedHandles)
+	{
+		if (HoveredHandles.Contains(Handle))
+		{
+			HoverEnded.Add(Handle);
+		}
+	}
+
+	TArray<FRTSSelectableHandle>& HoverStarted = SelectedBuffer;
+	HoverStarted.Reset();
+	for (const FRTSSelectableHandle& Handle : HoverStartedHandles)
+	{
+		if (SelectableRegistry->IsValid(Handle) && !HoveredHandles.Contains(Handle))
+		{
+			HoverStarted.Add(Handle);
+		}
+	}
+
+	ChangeHover(HoverStarted, HoverEnded);
 }
 
 void URTSSelectorSubsystem::SingleSelectEnd(const FInputActionValue& Value)
@@ -137,6 +533,7 @@ void URTSSelectorSubsystem::SingleSelectEnd(const FInputActionValue& Value)
 	HUD->PositionOnMouse();
 	HUD->EndGroupSelection();
 	bSingleSelect = true;
+	bResolveSelectionPending = CVarRTSSelectionResolveAfterActorTick.GetValueOnGameThread();
 }
 
 void URTSSelectorSubsystem::GroupSelectStart(const FInputActionValue& Value)
@@ -170,6 +567,7 @@ void URTSSelectorSubsystem::GroupSelectEnd(const FInputActionValue& Value)
 {
 	bGroupSelecting = false;
 	HUD->EndGroupSelection();
+	bResolveSelectionPending = CVarRTSSelectionResolveAfterActorTick.GetValueOnGameThread();
 }
 
 void URTSSelectorSubsystem::ShiftDown(const FInputActionValue& Value)
@@ -182,30 +580,128 @@ void URTSSelectorSubsystem::ShiftUp(const FInputActionValue& Value)
 	bShiftDown = false;
 }
 
+/**
+ * Hovers the selectable under the cursor, through ChangeHover so hover listeners and indicators see it too
+ * @param Selectable 
+ */
 void URTSSelectorSubsystem::RegisterHoverStart(URTSSelectable* Selectable)
 {
-	if(bGroupSelecting)
+	const FRTSSelectableHandle& Handle = Selectable->GetSelectableHandle();
+	if(bGroupSelecting || this->HoveredHandles.Contains(Handle))
 	{
 		return;
 	}
 	
-	this->HoveredSet.Add(Selectable);
-	
-	Selectable->HoverStart();
+	this->ChangeHover(MakeArrayView(&Handle, 1), TConstArrayView<FRTSSelectableHandle>());
 }
 
 void URTSSelectorSubsystem::RegisterHoverEnd(URTSSelectable* Selectable)
 {
-	if(bGroupSelecting)
+	const FRTSSelectableHandle& Handle = Selectable->GetSelectableHandle();
+	if(bGroupSelecting || !this->HoveredHandles.Contains(Handle))
 	{
 		return;
 	}
 	
 	// UE_LOG(LogTemp, Warning, TEXT("SelectorSubsystem - Hover End"));
 
-	this->HoveredSet.Remove(Selectable);
-	
-	Selectable->HoverEnd();
+	this->ChangeHover(TConstArrayView<FRTSSelectableHandle>(), MakeArrayView(&Handle, 1));
+}
+
+const FRTSScreenProjectionCache* URTSSelectorSubsystem::GetScreenProjections()
+{
+	if (PlayerController == nullptr || SelectableRegistry == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Snapshotted once a frame whatever moves in between, otherwise code looking up every unit while units move
+	// would update the cache on every lookup
+	if (ScreenProjectionFrame != GFrameCounter)
+	{
+		ScreenProjectionFrame = GFrameCounter;
+		bHasScreenProjectionView = ScreenProjectionView.Init(PlayerController);
+
+		if (bHasScreenProjectionView)
+		{
+			ScreenProjectionCache.Update(ScreenProjectionView, *SelectableRegistry);
+		}
+	}
+
+	return bHasScreenProjectionView ? &ScreenProjectionCache : nullptr;
+}
+
+const FRTSScreenProjectionCache* URTSSelectorSubsystem::FindScreenProjections(const FRTSSelectionView& View) const
+{
+	if (SelectableRegistry == nullptr || !ScreenProjectionCache.IsValidFor(View, *SelectableRegistry))
+	{
+		return nullptr;
+	}
+
+	return &ScreenProjectionCache;
+}
+
+/**
+ * Picks the selectable whose projected selection proxy is centered closest to the cursor, the one a click on
+ * overlapping units means. Falls back to the first one when nothing can be projected.
+ * @param Handles 
+ */
+FRTSSelectableHandle URTSSelectorSubsystem::FindClosestToCursor(const TConstArrayView<FRTSSelectableHandle> Handles)
+{
+	if (Handles.Num() == 0)
+	{
+		return FRTSSelectableHandle();
+	}
+
+	FVector2f CursorPosition;
+	const FRTSScreenProjectionCache* Projections = Handles.Num() > 1 ? GetScreenProjections() : nullptr;
+	if (Projections == nullptr || !PlayerController->GetMousePosition(CursorPosition.X, CursorPosition.Y))
+	{
+		return Handles[0];
+	}
+
+	FRTSSelectableHandle ClosestHandle = Handles[0];
+	float ClosestDistanceSquared = TNumericLimits<float>::Max();
+	for (const FRTSSelectableHandle& Handle : Handles)
+	{
+		const int32 Index = Projections->FindIndex(Handle);
+		if (Index == INDEX_NONE || !Projections->GetScreenRect(Index).bIsValid)
+		{
+			continue;
+		}
+
+		const float DistanceSquared = FVector2f::DistSquared(Projections->GetScreenRect(Index).GetCenter(), CursorPosition);
+		if (DistanceSquared < ClosestDistanceSquared)
+		{
+			ClosestHandle = Handle;
+			ClosestDistanceSquared = DistanceSquared;
+		}
+	}
+
+	return ClosestHandle;
+}
+
+/**
+ * Looks up the actor's projected selection proxy in the screen projection cache
+ * @param Actor 
+ * @param OutScreenRect 
+ */
+bool URTSSelectorSubsystem::GetSelectableScreenRect(const AActor* Actor, FBox2D& OutScreenRect)
+{
+	const FRTSScreenProjectionCache* Projections = GetScreenProjections();
+	if (Projections == nullptr)
+	{
+		return false;
+	}
+
+	const int32 Index = Projections->FindIndex(SelectableRegistry->FindHandle(Actor));
+	if (Index == INDEX_NONE || !Projections->GetScreenRect(Index).bIsValid)
+	{
+		return false;
+	}
+
+	OutScreenRect = FBox2D(Projections->GetScreenRect(Index));
+	return true;
 }
 
 void URTSSelectorSubsystem::Initialize(FSubsystemCollectionBase& Collection)
@@ -213,6 +709,127 @@ void URTSSelectorSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	Super::Initialize(Collection);
 
 	// UE_LOG(LogTemp, Warning, TEXT("SelectorSubsystem - Initialize"));
+
+	// Flushed after the HUD has drawn, so hover changes from the selection box go out in the frame they happened
+	EndFrameHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &URTSSelectorSubsystem::FlushSelectionStateChanges);
+	PostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddUObject(this, &URTSSelectorSubsystem::OnWorldPostActorTick);
+}
+
+void URTSSelectorSubsystem::Deinitialize()
+{
+	FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+	FWorldDelegates::OnWorldPostActorTick.Remove(PostActorTickHandle);
+	
+	Super::Deinitialize();
+}
+
+ARTSSelectionIndicators* URTSSelectorSubsystem::SpawnSelectionIndicators(TSubclassOf<ARTSSelectionIndicators> IndicatorsClass)
+{
+	if (PlayerController == nullptr)
+	{
+		return nullptr;
+	}
+
+	if (SelectionIndicators)
+	{
+		OnSelectionStatesChangedDelegate.RemoveAll(SelectionIndicators);
+		SelectionIndicators->Destroy();
+	}
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+	
+	SelectionIndicators = PlayerController->GetWorld()->SpawnActor<ARTSSelectionIndicators>(
+		IndicatorsClass ? IndicatorsClass.Get() : ARTSSelectionIndicators::StaticClass(),
+		SpawnParameters
+	);
+	if (SelectionIndicators == nullptr)
+	{
+		return nullptr;
+	}
+	
+	SelectionIndicators->SetRegistry(SelectableRegistry);
+	OnSelectionStatesChangedDelegate.AddUObject(SelectionIndicators, &ARTSSelectionIndicators::OnSelectionStatesChanged);
+
+	// Catch up with whatever is already hovered or selected
+	ChangedSelectables.Reset();
+	ResolveSelectables(SelectedHandles, ChangedSelectables);
+	for (const FRTSSelectableHandle& Hovered : HoveredHandles)
+	{
+		URTSSelectable* Selectable = SelectableRegistry->Resolve(Hovered);
+		if (Selectable && !SelectedHandles.Contains(Hovered))
+		{
+			ChangedSelectables.Add(Selectable);
+		}
+	}
+	SelectionIndicators->OnSelectionStatesChanged(ChangedSelectables);
+
+	return SelectionIndicators;
+}
+
+void URTSSelectorSubsystem::MarkSelectionStateDirty(URTSSelectable* Selectable)
+{
+	DirtySelectables.Add(Selectable);
+}
+
+/**
+ * Broadcasts the selection state of every selectable that changed since the last flush, once per selectable however
+ * many times it changed. Selectables that ended up back in the state last broadcast are skipped.
+ */
+void URTSSelectorSubsystem::FlushSelectionStateChanges()
+{
+	if (DirtySelectables.Num() == 0)
+	{
+		return;
+	}
+
+	// Anything marked dirty by the notifications below goes out with the next flush
+	Swap(DirtySelectables, FlushingSelectables);
+
+	ChangedSelectables.Reset();
+	for (URTSSelectable* Selectable : FlushingSelectables)
+	{
+		if (IsValid(Selectable) && Selectable->ConsumeSelectionStateChange())
+		{
+			ChangedSelectables.Add(Selectable);
+		}
+	}
+	FlushingSelectables.Reset();
+
+	if (ChangedSelectables.Num() == 0)
+	{
+		return;
+	}
+
+	OnSelectionStatesChangedDelegate.Broadcast(ChangedSelectables);
+
+	for (URTSSelectable* Selectable : ChangedSelectables)
+	{
+		if (IsValid(Selectable) && Selectable->OnSelectionStateChangedDelegate.IsBound())
+		{
+			Selectable->OnSelectionStateChangedDelegate.Broadcast(Selectable->GetSelectionState());
+		}
+	}
+}
+
+/**
+ * Resolves a final selection requested by this frame's input, still ahead of the HUD draw
+ * @param World 
+ * @param TickType 
+ * @param DeltaSeconds 
+ */
+void URTSSelectorSubsystem::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	if (!bResolveSelectionPending || PlayerController == nullptr || PlayerController->GetWorld() != World)
+	{
+		return;
+	}
+
+	bResolveSelectionPending = false;
+	if (HUD)
+	{
+		HUD->ResolveFinalSelection();
+	}
 }
 
 void URTSSelectorSubsystem::BindInputActions()
@@ -282,48 +899,81 @@ void URTSSelectorSubsystem::BindInputMappingContext()
 }
 
 /**
- * Selects the actors filtering for actors with the selectable component in and broadcasts the selection
- * Calls the select function on the selectable component on all valid actors
- * @param ActorsToSelect 
+ * Broadcasts the owners of the selectables through one of the Blueprint delegates, if anything is bound to it.
+ * Proxies have no owner and are left out.
+ * @param Delegate 
+ * @param Registry 
+ * @param Handles 
+ * @param ActorsBuffer Scratch array for the owners
  */
-void URTSSelectorSubsystem::SelectActors(const TArray<URTSSelectable*>& ActorsToSelect)
+template <typename FDynamicDelegate>
+static void MirrorToBlueprintDelegate(
+	FDynamicDelegate& Delegate,
+	const URTSSelectableRegistry& Registry,
+	const TConstArrayView<FRTSSelectableHandle> Handles,
+	TArray<AActor*>& ActorsBuffer
+)
 {
-	TArray<AActor*> BroadcastActors;
-
-	// Looks for actors with the selectable component and calls the select function on them
-	for (const auto& Selectable : ActorsToSelect)
+	if (Handles.Num() == 0 || !Delegate.IsBound())
 	{
-		this->SelectedSet.Add(Selectable);
-		Selectable->Select();
-		BroadcastActors.Add(Selectable->GetOwner());
+		return;
 	}
 
-	if(BroadcastActors.Num() > 0)
+	ActorsBuffer.Reset();
+	for (const FRTSSelectableHandle& Handle : Handles)
+	{
+		if (AActor* Actor = Registry.ResolveActor(Handle))
+		{
+			ActorsBuffer.Add(Actor);
+		}
+	}
+	
+	if (ActorsBuffer.Num() > 0)
 	{
-		OnActorsSelectedDelegate.Broadcast(BroadcastActors);
+		Delegate.Broadcast(ActorsBuffer);
 	}
 }
 
 /**
- * Deselects the actors filtering for actors with the selectable component in and broadcasts the deselection
- * Calls the deselect function on the selectable component on all valid actors
- * @param ActorsToDeselect 
+ * Deselects and selects the given selectables, then broadcasts both sides of the change at once through
+ * the native selection delegate, and through the Blueprint ones if enabled
+ * @param HandlesToSelect 
+ * @param HandlesToDeselect 
  */
-void URTSSelectorSubsystem::DeselectActors(const TArray<URTSSelectable*>& ActorsToDeselect)
+void URTSSelectorSubsystem::ChangeSelection(
+	const TConstArrayView<FRTSSelectableHandle> HandlesToSelect,
+	const TConstArrayView<FRTSSelectableHandle> HandlesToDeselect
+)
 {
-	TArray<AActor*> BroadcastActors;
+	if (HandlesToSelect.Num() == 0 && HandlesToDeselect.Num() == 0)
+	{
+		return;
+	}
 	
-	// Iterate over currently selected actors
-	for (const auto& Selectable : ActorsToDeselect)
+	for (const FRTSSelectableHandle& Handle : HandlesToDeselect)
 	{
-		SelectedSet.Remove(Selectable);
-		Selectable->Deselect();
-		BroadcastActors.Add(Selectable->GetOwner());
+		SelectedHandles.Remove(Handle);
+		if (URTSSelectable* Selectable = SelectableRegistry->Resolve(Handle))
+		{
+			Selectable->Deselect();
+		}
 	}
 	
-	if(BroadcastActors.Num() > 0)
+	for (const FRTSSelectableHandle& Handle : HandlesToSelect)
 	{
-		OnActorsDeselectedDelegate.Broadcast(BroadcastActors);
+		SelectedHandles.Add(Handle);
+		if (URTSSelectable* Selectable = SelectableRegistry->Resolve(Handle))
+		{
+			Selectable->Select();
+		}
+	}
+
+	OnSelectionChangedDelegate.Broadcast(HandlesToSelect, HandlesToDeselect);
+
+	if (bBroadcastBlueprintDelegates)
+	{
+		MirrorToBlueprintDelegate(OnActorsDeselectedDelegate, *SelectableRegistry, HandlesToDeselect, BroadcastActorsBuffer);
+		MirrorToBlueprintDelegate(OnActorsSelectedDelegate, *SelectableRegistry, HandlesToSelect, BroadcastActorsBuffer);
 	}
 }
 
@@ -332,104 +982,153 @@ void URTSSelectorSubsystem::DeselectActors(const TArray<URTSSelectable*>& Actors
  */
 void URTSSelectorSubsystem::DeselectActors()
 {
-	TArray<AActor*> BroadcastActors;
-	
-	// Iterate over currently selected actors
-	for (const auto& Selectable : SelectedSet)
-	{
-		Selectable->Deselect();
-		BroadcastActors.Add(Selectable->GetOwner());
-	}
-
-	SelectedSet.Empty();
+	TArray<FRTSSelectableHandle>& Deselected = DeselectedBuffer;
+	Deselected.Reset();
+	Deselected.Append(SelectedHandles.GetHandles().GetData(), SelectedHandles.Num());
 
-	if(BroadcastActors.Num() > 0)
-	{
-		OnActorsDeselectedDelegate.Broadcast(BroadcastActors);
-	}
+	TArray<FRTSSelectableHandle>& Selected = SelectedBuffer;
+	Selected.Reset();
+	
+	ChangeSelection(Selected, Deselected);
 }
 
 /**
- * Hover over the actors filtering for actors with the selectable component in and broadcasts the hover start
- * Calls the hover start function on the selectable component on all valid actors
- * @param ActorsToHover 
+ * Ends and starts hovering the given selectables, then broadcasts both sides of the change at once through
+ * the native hover delegate, and through the Blueprint ones if enabled
+ * @param HandlesToHover 
+ * @param HandlesToUnhover 
  */
-void URTSSelectorSubsystem::HoverActors(const TArray<URTSSelectable*>& ActorsToHover)
+void URTSSelectorSubsystem::ChangeHover(
+	const TConstArrayView<FRTSSelectableHandle> HandlesToHover,
+	const TConstArrayView<FRTSSelectableHandle> HandlesToUnhover
+)
 {
-	TArray<AActor*> BroadcastActors;
+	if (HandlesToHover.Num() == 0 && HandlesToUnhover.Num() == 0)
+	{
+		return;
+	}
+
+	for (const FRTSSelectableHandle& Handle : HandlesToUnhover)
+	{
+		HoveredHandles.Remove(Handle);
+		if (URTSSelectable* Selectable = SelectableRegistry->Resolve(Handle))
+		{
+			Selectable->HoverEnd();
+		}
+	}
 	
-	for (const auto& Selectable : ActorsToHover)
+	for (const FRTSSelectableHandle& Handle : HandlesToHover)
 	{
-		this->HoveredSet.Add(Selectable);
-		Selectable->HoverStart();
-		BroadcastActors.Add(Selectable->GetOwner());
+		HoveredHandles.Add(Handle);
+		if (URTSSelectable* Selectable = SelectableRegistry->Resolve(Handle))
+		{
+			Selectable->HoverStart();
+		}
 	}
 
-	if(BroadcastActors.Num() > 0)
+	OnHoverChangedDelegate.Broadcast(HandlesToHover, HandlesToUnhover);
+
+	if (bBroadcastBlueprintDelegates)
 	{
-		OnActorsHoverStartDelegate.Broadcast(BroadcastActors);
+		MirrorToBlueprintDelegate(OnActorsHoverEndDelegate, *SelectableRegistry, HandlesToUnhover, BroadcastActorsBuffer);
+		MirrorToBlueprintDelegate(OnActorsHoverStartDelegate, *SelectableRegistry, HandlesToHover, BroadcastActorsBuffer);
 	}
 }
 
 /**
- * Unhover over the actors filtering for actors with the selectable component in and broadcasts the hover end
- * Calls the hover end function on the selectable component on all valid actors
- * @param ActorsToUnhover 
+ * Unhovers everything and broadcasts the hover end
  */
-void URTSSelectorSubsystem::UnhoverActors(const TArray<URTSSelectable*>& ActorsToUnhover)
+void URTSSelectorSubsystem::UnhoverActors()
 {
-	TArray<AActor*> BroadcastActors;
+	TArray<FRTSSelectableHandle>& HoverEnded = DeselectedBuffer;
+	HoverEnded.Reset();
+	HoverEnded.Append(HoveredHandles.GetHandles().GetData(), HoveredHandles.Num());
 
-	// Iterate over currently selected actors
-	for (const auto& Hovered : ActorsToUnhover)
+	TArray<FRTSSelectableHandle>& HoverStarted = SelectedBuffer;
+	HoverStarted.Reset();
+	
+	ChangeHover(HoverStarted, HoverEnded);
+}
+
+/**
+ * Gets the registry handles of the actors through its actor lookup
+ * Actors without a registered selectable component are skipped
+ * @param Actors 
+ * @param OutHandles 
+ */
+void URTSSelectorSubsystem::GetHandlesFromActors(const TArray<AActor*>& Actors,
+	TArray<FRTSSelectableHandle>& OutHandles) const
+{
+	if (!SelectableRegistry)
 	{
-		HoveredSet.Remove(Hovered);
-		Hovered->HoverEnd();
-		BroadcastActors.Add(Hovered->GetOwner());
+		return;
 	}
-
-	if(BroadcastActors.Num() > 0)
+	
+	for (const auto& Actor : Actors)
 	{
-		OnActorsHoverEndDelegate.Broadcast(BroadcastActors);
+		const FRTSSelectableHandle Handle = SelectableRegistry->FindHandle(Actor);
+		if (Handle.IsSet())
+		{
+			OutHandles.Add(Handle);
+		}
 	}
 }
 
+TArray<URTSSelectable*> URTSSelectorSubsystem::GetSelected() const
+{
+	TArray<URTSSelectable*> Selectables;
+	ResolveSelectables(SelectedHandles, Selectables);
+	return Selectables;
+}
+
+TArray<URTSSelectable*> URTSSelectorSubsystem::GetHovered() const
+{
+	TArray<URTSSelectable*> Selectables;
+	ResolveSelectables(HoveredHandles, Selectables);
+	return Selectables;
+}
+
 /**
- * Unhover over the actors filtering for actors with the selectable component in and broadcasts the hover end
- * Calls the hover end function on the selectable component on all valid actors
+ * Resolves every handle in the set to its selectable, skipping proxies as they have none
+ * @param Handles 
+ * @param OutSelectables 
  */
-void URTSSelectorSubsystem::UnhoverActors()
+void URTSSelectorSubsystem::ResolveSelectables(
+	const FRTSSelectableHandleSet& Handles,
+	TArray<URTSSelectable*>& OutSelectables
+) const
 {
-	TArray<AActor*> BroadcastActors;
-	
-	for (const auto& Hovered : HoveredSet)
+	if (!SelectableRegistry)
 	{
-		// Call OnDeselected for actors that are no longer selected
-		Hovered->HoverEnd();
-		BroadcastActors.Add(Hovered->GetOwner());
+		return;
 	}
 
-	HoveredSet.Empty();
-
-	if(BroadcastActors.Num() > 0)
+	for (const FRTSSelectableHandle& Handle : Handles)
 	{
-		OnActorsHoverEndDelegate.Broadcast(BroadcastActors);
+		if (URTSSelectable* Selectable = SelectableRegistry->Resolve(Handle))
+		{
+			OutSelectables.Add(Selectable);
+		}
 	}
 }
 
 /**
- * Gets the selectable components from the actors
- * @param Actors 
- * @param OutSelectables 
+ * Evicts a selectable going away from the selection and hover, telling native listeners it left them.
+ * The selectable is mid EndPlay, so it isn't deselected and the Blueprint delegates aren't broadcast.
+ * @param Handle 
  */
-void URTSSelectorSubsystem::GetSelectablesFromActors(const TArray<AActor*>& Actors,
-	TArray<URTSSelectable*>& OutSelectables)
+void URTSSelectorSubsystem::OnSelectableUnregistered(const FRTSSelectableHandle& Handle)
 {
-	for (const auto& Actor : Actors)
+	// Can fire from inside a selection broadcast, so the shared handle buffers can't be used here
+	const TConstArrayView<FRTSSelectableHandle> Removed(&Handle, 1);
+
+	if (SelectedHandles.Remove(Handle))
 	{
-		if (URTSSelectable* SelectableComponent = Actor->FindComponentByClass<URTSSelectable>())
-		{
-			OutSelectables.Add(SelectableComponent);
-		}
+		OnSelectionChangedDelegate.Broadcast(TConstArrayView<FRTSSelectableHandle>(), Removed);
+	}
+
+	if (HoveredHandles.Remove(Handle))
+	{
+		OnHoverChangedDelegate.Broadcast(TConstArrayView<FRTSSelectableHandle>(), Removed);
 	}
 }
@@ -0,0 +1,90 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSGroundHeightCache.h"
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RTSGroundHeightCacheTest
+{
+	// Bilinear filtering reproduces a plane exactly, wherever the samples fall
+	double PlaneHeight(const FVector2D& Location)
+	{
+		return 0.5 * Location.X - 0.25 * Location.Y + 30.0;
+	}
+
+	// Ground ends at X = 5000
+	constexpr double GroundEndX = 5000.0;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+	FRTSGroundHeightCacheTest,
+	"OpenRTSCamera.Camera.GroundHeightCache",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter
+)
+
+bool FRTSGroundHeightCacheTest::RunTest(const FString& Parameters)
+{
+	using namespace RTSGroundHeightCacheTest;
+
+	int32 NumSamples = 0;
+	const auto SampleHeight = [&NumSamples](const FVector2D& Location, double& OutHeight)
+	{
+		NumSamples++;
+		OutHeight = PlaneHeight(Location);
+		return Location.X < GroundEndX;
+	};
+
+	FRTSGroundHeightCache Cache;
+	Cache.Configure(100.0f, 4);
+
+	// Negative coordinates land in the tiles left of and below the origin
+	const FVector2D Location(1234.5, -678.9);
+	double Height = 0.0;
+	TestTrue(TEXT("Height found"), Cache.GetHeight(Location, SampleHeight, Height));
+	TestEqual(TEXT("Filtered height"), Height, PlaneHeight(Location), 1.0e-6);
+	TestEqual(TEXT("Samples taken by the first lookup"), NumSamples, 4);
+
+	const FVector2D NearbyLocation(1250.0, -650.0);
+	TestTrue(TEXT("Nearby height found"), Cache.GetHeight(NearbyLocation, SampleHeight, Height));
+	TestEqual(TEXT("Nearby filtered height"), Height, PlaneHeight(NearbyLocation), 1.0e-6);
+	TestEqual(TEXT("Samples taken by a lookup between the same samples"), NumSamples, 4);
+
+	// Only the sample at (1200, -700) is inside the box
+	Cache.Invalidate(FBox(FVector(1150.0, -750.0, -1.0), FVector(1250.0, -650.0, 1.0)));
+	TestTrue(TEXT("Height found after invalidating"), Cache.GetHeight(Location, SampleHeight, Height));
+	TestEqual(TEXT("Samples taken after invalidating one"), NumSamples, 5);
+
+	// Samples without ground are left out of the filter
+	const FVector2D EdgeLocation(GroundEndX - 50.0, 50.0);
+	TestTrue(TEXT("Height found next to samples without ground"), Cache.GetHeight(EdgeLocation, SampleHeight, Height));
+	TestEqual(
+		TEXT("Height filtered from the samples with ground only"),
+		Height,
+		PlaneHeight(FVector2D(GroundEndX - 100.0, 50.0)),
+		1.0e-6
+	);
+	TestFalse(
+		TEXT("No height where no surrounding sample has ground"),
+		Cache.GetHeight(FVector2D(GroundEndX + 1000.5, 0.0), SampleHeight, Height)
+	);
+
+	// Tiles span 8 samples, every lookup here needs new ones
+	for (int32 Step = 1; Step <= 8; Step++)
+	{
+		Cache.GetHeight(FVector2D(-Step * 10000.0, Step * 10000.0), SampleHeight, Height);
+	}
+	TestTrue(TEXT("Tiles are evicted past the limit"), Cache.NumTiles() <= 4);
+
+	const int32 NumSamplesBeforeEvicted = NumSamples;
+	Cache.GetHeight(Location, SampleHeight, Height);
+	TestEqual(TEXT("Evicted samples are taken again"), NumSamples, NumSamplesBeforeEvicted + 4);
+
+	Cache.Configure(50.0f, 4);
+	TestEqual(TEXT("Tiles after changing the spacing"), Cache.NumTiles(), 0);
+
+	return true;
+}
+
+#endif
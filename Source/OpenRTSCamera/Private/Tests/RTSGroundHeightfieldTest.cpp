@@ -0,0 +1,161 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSGroundHeightfield.h"
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RTSGroundHeightfieldTest
+{
+	const FVector2D Origin(-1000.0, 500.0);
+	constexpr float SampleSpacing = 100.0f;
+	const FIntPoint Size(9, 6);
+
+	// Curved along Y, so filtering between samples isn't exact and quantization error shows
+	double SampleHeight(const int32 X, const int32 Y)
+	{
+		return 10.0 * X + 3.0 * Y * Y - 200.0;
+	}
+
+	// A 2 by 2 block of samples without ground
+	bool IsHole(const int32 X, const int32 Y)
+	{
+		return X >= 6 && X <= 7 && Y >= 3 && Y <= 4;
+	}
+
+	FVector2D GetLocation(const double X, const double Y)
+	{
+		return Origin + FVector2D(X, Y) * SampleSpacing;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+	FRTSGroundHeightfieldTest,
+	"OpenRTSCamera.Camera.GroundHeightfield",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter
+)
+
+bool FRTSGroundHeightfieldTest::RunTest(const FString& Parameters)
+{
+	using namespace RTSGroundHeightfieldTest;
+
+	TArray<double> SampledHeights;
+	TBitArray<> SampledGround(false, Size.X * Size.Y);
+	SampledHeights.SetNumZeroed(Size.X * Size.Y);
+
+	double LowestHeight = TNumericLimits<double>::Max();
+	double HighestHeight = TNumericLimits<double>::Lowest();
+	for (int32 Y = 0; Y < Size.Y; Y++)
+	{
+		for (int32 X = 0; X < Size.X; X++)
+		{
+			if (!IsHole(X, Y))
+			{
+				SampledHeights[Y * Size.X + X] = SampleHeight(X, Y);
+				SampledGround[Y * Size.X + X] = true;
+				LowestHeight = FMath::Min(LowestHeight, SampleHeight(X, Y));
+				HighestHeight = FMath::Max(HighestHeight, SampleHeight(X, Y));
+			}
+		}
+	}
+
+	URTSGroundHeightfield* Heightfield = NewObject<URTSGroundHeightfield>();
+	if (!TestTrue(TEXT("Built"), Heightfield->Build(Origin, SampleSpacing, Size, SampledHeights, SampledGround)))
+	{
+		return false;
+	}
+
+	// One quantization step, plus the tiny weight every sample keeps in the filter
+	const double Tolerance = (HighestHeight - LowestHeight) / (URTSGroundHeightfield::NoGround - 1) + 0.02;
+
+	double Height = 0.0;
+	for (int32 Y = 0; Y < Size.Y; Y++)
+	{
+		for (int32 X = 0; X < Size.X; X++)
+		{
+			const FString What = FString::Printf(TEXT("Sample %d, %d"), X, Y);
+			if (IsHole(X, Y))
+			{
+				continue;
+			}
+
+			if (TestTrue(What + TEXT(" has a height"), Heightfield->GetHeight(GetLocation(X, Y), Height)))
+			{
+				TestEqual(What + TEXT(" height after quantizing"), Height, SampleHeight(X, Y), Tolerance);
+			}
+		}
+	}
+
+	TestTrue(TEXT("Height between samples"), Heightfield->GetHeight(GetLocation(2.5, 1.5), Height));
+	TestEqual(
+		TEXT("Height between samples is their average"),
+		Height,
+		(SampleHeight(2, 1) + SampleHeight(3, 1) + SampleHeight(2, 2) + SampleHeight(3, 2)) / 4.0,
+		Tolerance
+	);
+
+	// Samples without ground are left out of the filter, as in FRTSGroundHeightCache
+	TestTrue(TEXT("Height next to the hole"), Heightfield->GetHeight(GetLocation(5.5, 3.5), Height));
+	TestEqual(
+		TEXT("Height next to the hole is filtered from the ground only"),
+		Height,
+		(SampleHeight(5, 3) + SampleHeight(5, 4)) / 2.0,
+		Tolerance
+	);
+	TestFalse(TEXT("No height inside the hole"), Heightfield->GetHeight(GetLocation(6.5, 3.5), Height));
+
+	TestFalse(TEXT("Outside isn't contained"), Heightfield->Contains(GetLocation(-0.5, 1.0)));
+	TestFalse(TEXT("No height outside"), Heightfield->GetHeight(GetLocation(1.0, Size.Y - 0.5), Height));
+	TestTrue(TEXT("The far corner is contained"), Heightfield->Contains(GetLocation(Size.X - 1, Size.Y - 1)));
+
+	// Conservative, every height under the area lies within the range
+	const FBox2D Area(GetLocation(0.2, 0.3), GetLocation(3.0, 1.4));
+	double MinHeight = 0.0;
+	double MaxHeight = 0.0;
+	if (TestTrue(TEXT("Range away from the hole"), Heightfield->GetHeightRange(Area, MinHeight, MaxHeight)))
+	{
+		for (int32 Y = 0; Y <= 2; Y++)
+		{
+			for (int32 X = 0; X <= 3; X++)
+			{
+				TestTrue(
+					FString::Printf(TEXT("Sample %d, %d is within the range"), X, Y),
+					SampleHeight(X, Y) >= MinHeight - Tolerance && SampleHeight(X, Y) <= MaxHeight + Tolerance
+				);
+			}
+		}
+
+		for (const FVector2D& Location : {Area.Min, Area.Max, Area.GetCenter()})
+		{
+			Heightfield->GetHeight(Location, Height);
+			TestTrue(
+				TEXT("Filtered height is within the range"),
+				Height >= MinHeight - UE_KINDA_SMALL_NUMBER && Height <= MaxHeight + UE_KINDA_SMALL_NUMBER
+			);
+		}
+	}
+
+	TestFalse(
+		TEXT("No range touching the hole"),
+		Heightfield->GetHeightRange(FBox2D(GetLocation(6.2, 3.2), GetLocation(6.8, 3.8)), MinHeight, MaxHeight)
+	);
+	TestFalse(
+		TEXT("No range outside"),
+		Heightfield->GetHeightRange(FBox2D(GetLocation(-3.0, -3.0), GetLocation(-1.0, -1.0)), MinHeight, MaxHeight)
+	);
+
+	// Flat ground has no height step at all
+	TArray<double> FlatHeights;
+	FlatHeights.Init(50.0, 4);
+	TestTrue(TEXT("Flat ground built"), Heightfield->Build(Origin, SampleSpacing, FIntPoint(2, 2), FlatHeights, TBitArray<>(true, 4)));
+	TestTrue(TEXT("Flat ground has a height"), Heightfield->GetHeight(GetLocation(0.5, 0.5), Height));
+	TestEqual(TEXT("Flat ground height"), Height, 50.0, UE_KINDA_SMALL_NUMBER);
+
+	TestFalse(TEXT("Nothing built without ground"), Heightfield->Build(Origin, SampleSpacing, FIntPoint(2, 2), FlatHeights, TBitArray<>(false, 4)));
+	TestFalse(TEXT("Nothing baked without ground"), Heightfield->IsBaked());
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,82 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSSelectableHandleSet.h"
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RTSSelectableHandleSetTest
+{
+	FRTSSelectableHandle MakeHandle(const int32 Index, const uint32 Generation)
+	{
+		FRTSSelectableHandle Handle;
+		Handle.Index = Index;
+		Handle.Generation = Generation;
+		return Handle;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+	FRTSSelectableHandleSetTest,
+	"OpenRTSCamera.Selection.HandleSet",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter
+)
+
+bool FRTSSelectableHandleSetTest::RunTest(const FString& Parameters)
+{
+	using namespace RTSSelectableHandleSetTest;
+
+	FRTSSelectableHandleSet Set;
+	TestFalse(TEXT("Unset handles aren't added"), Set.Add(FRTSSelectableHandle()));
+	TestFalse(TEXT("Empty set contains nothing"), Set.Contains(MakeHandle(0, 1)));
+
+	// Out of order and sparse slots, so the sparse array has to grow past the dense one
+	const FRTSSelectableHandle First = MakeHandle(7, 1);
+	const FRTSSelectableHandle Second = MakeHandle(2, 3);
+	const FRTSSelectableHandle Third = MakeHandle(40, 1);
+	TestTrue(TEXT("First handle is added"), Set.Add(First));
+	TestTrue(TEXT("Second handle is added"), Set.Add(Second));
+	TestTrue(TEXT("Third handle is added"), Set.Add(Third));
+	TestFalse(TEXT("Adding a handle twice is refused"), Set.Add(Second));
+	TestEqual(TEXT("Num after adding"), Set.Num(), 3);
+	TestFalse(TEXT("A slot never added isn't contained"), Set.Contains(MakeHandle(8, 1)));
+	TestFalse(TEXT("A slot past the sparse array isn't contained"), Set.Contains(MakeHandle(1000, 1)));
+
+	// A stale handle never matches, and the slot's new occupant replaces it
+	const FRTSSelectableHandle Reused = MakeHandle(7, 2);
+	TestFalse(TEXT("Another generation in the same slot isn't contained"), Set.Contains(Reused));
+	TestFalse(TEXT("Another generation in the same slot isn't removed"), Set.Remove(Reused));
+	TestTrue(TEXT("The new occupant of a slot is added"), Set.Add(Reused));
+	TestEqual(TEXT("Num after replacing a stale handle"), Set.Num(), 3);
+	TestTrue(TEXT("The new occupant is contained"), Set.Contains(Reused));
+	TestFalse(TEXT("The stale handle is gone"), Set.Contains(First));
+
+	// Removal swaps the last handle into the hole, which must stay reachable through its slot
+	TestTrue(TEXT("Removing a contained handle"), Set.Remove(Reused));
+	TestFalse(TEXT("Removing it again"), Set.Remove(Reused));
+	TestEqual(TEXT("Num after removing"), Set.Num(), 2);
+	TestTrue(TEXT("Second is still contained after the swap"), Set.Contains(Second));
+	TestTrue(TEXT("Third is still contained after the swap"), Set.Contains(Third));
+	TestTrue(TEXT("Third can be removed after moving"), Set.Remove(Third));
+	TestTrue(TEXT("Second is still contained"), Set.Contains(Second));
+
+	int32 NumIterated = 0;
+	for (const FRTSSelectableHandle& Handle : Set)
+	{
+		TestTrue(TEXT("Iterated handle is the one left"), Handle == Second);
+		NumIterated++;
+	}
+	TestEqual(TEXT("Handles iterated"), NumIterated, Set.Num());
+	TestEqual(TEXT("Handle view size"), Set.GetHandles().Num(), Set.Num());
+
+	Set.Reset();
+	TestEqual(TEXT("Num after reset"), Set.Num(), 0);
+	TestFalse(TEXT("Reset clears the sparse slots"), Set.Contains(Second));
+	TestTrue(TEXT("Handles can be added after a reset"), Set.Add(Second));
+	TestTrue(TEXT("And are contained"), Set.Contains(Second));
+
+	return true;
+}
+
+#endif
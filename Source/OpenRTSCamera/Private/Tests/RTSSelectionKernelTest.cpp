@@ -0,0 +1,234 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#include "RTSSelectionKernel.h"
+
+#include "CoreGlobals.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/InverseRotationMatrix.h"
+#include "Math/OrthoMatrix.h"
+#include "Math/PerspectiveMatrix.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RTSSelectionKernelTest
+{
+	static const FRotator ViewRotation(-50.0, 30.0, 0.0);
+
+	FRTSSelectionView MakeView(const bool bOrthographic)
+	{
+		FRTSSelectionView View;
+		View.ViewOrigin = FVector(250000.0, -120000.0, 3000.0);
+		View.ViewRect = FIntRect(0, 0, 1920, 1080);
+
+		// Swizzles from X forward and Z up to the Z forward and Y up the projection expects, as FSceneView does
+		const FMatrix ViewRotationMatrix = FInverseRotationMatrix(ViewRotation) * FMatrix(
+			FPlane(0, 0, 1, 0),
+			FPlane(1, 0, 0, 0),
+			FPlane(0, 1, 0, 0),
+			FPlane(0, 0, 0, 1)
+		);
+
+		// Depth doesn't matter to the kernel
+		const FMatrix ProjectionMatrix = bOrthographic
+			? FMatrix(FReversedZOrthoMatrix(8000.0, 4500.0, 1.0e-6, 0.0))
+			: FMatrix(FReversedZPerspectiveMatrix(FMath::DegreesToRadians(45.0), 1920.0, 1080.0, GNearClippingPlane));
+
+		View.ViewProjection = FMatrix44f(ViewRotationMatrix * ProjectionMatrix);
+		return View;
+	}
+
+	// Mostly boxes in front of the view, some behind it and some crossing its near plane
+	void MakeBounds(const FRTSSelectionView& View, const int32 Num, const int32 Seed, FRTSSelectionBoundsSoA& OutBounds)
+	{
+		FRandomStream Random(Seed);
+		const FVector Forward = ViewRotation.Vector();
+
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			const float Kind = Random.FRand();
+			const FVector Center = Kind < 0.1f
+				? View.ViewOrigin + Forward * Random.FRandRange(-50.0f, 50.0f) + Random.VRand() * 30.0f
+				: Kind < 0.2f
+				? View.ViewOrigin - Forward * Random.FRandRange(500.0f, 20000.0f) + Random.VRand() * 5000.0f
+				: View.ViewOrigin + Forward * Random.FRandRange(500.0f, 30000.0f) + Random.VRand() * Random.FRandRange(0.0f, 15000.0f);
+
+			OutBounds.Add(
+				Center,
+				FVector(Random.FRandRange(10.0f, 400.0f), Random.FRandRange(10.0f, 400.0f), Random.FRandRange(10.0f, 400.0f))
+			);
+		}
+	}
+
+	/**
+	 * Projects the eight corners one at a time, adding where each edge crosses the near plane, with none of the
+	 * kernel's batching or shortcuts
+	 * @return False when the whole box is behind the near plane
+	 */
+	bool ProjectReference(const FRTSSelectionView& View, const FVector& Center, const FVector& Extent, FBox2f& OutScreenRect)
+	{
+		const FMatrix44f& M = View.ViewProjection;
+		const bool bOrthographic = M.M[0][3] == 0.0f && M.M[1][3] == 0.0f && M.M[2][3] == 0.0f;
+		const float NearW = bOrthographic ? 0.0f : GNearClippingPlane;
+
+		FVector4f Corners[8];
+		for (int32 Corner = 0; Corner < 8; Corner++)
+		{
+			const FVector Offset(
+				Corner & 1 ? Extent.X : -Extent.X,
+				Corner & 2 ? Extent.Y : -Extent.Y,
+				Corner & 4 ? Extent.Z : -Extent.Z
+			);
+			Corners[Corner] = M.TransformFVector4(FVector4f(FVector3f(Center + Offset - View.ViewOrigin), 1.0f));
+		}
+
+		TArray<FVector4f, TInlineAllocator<20>> Points;
+		for (int32 Corner = 0; Corner < 8; Corner++)
+		{
+			if (Corners[Corner].W >= NearW)
+			{
+				Points.Add(Corners[Corner]);
+			}
+
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				const int32 OtherCorner = Corner | (1 << Axis);
+				const FVector4f& From = Corners[Corner];
+				const FVector4f& To = Corners[OtherCorner];
+				if (OtherCorner != Corner && (From.W >= NearW) != (To.W >= NearW))
+				{
+					Points.Add(FMath::Lerp(From, To, (NearW - From.W) / (To.W - From.W)));
+				}
+			}
+		}
+
+		if (Points.Num() == 0)
+		{
+			return false;
+		}
+
+		const float HalfWidth = 0.5f * View.ViewRect.Width();
+		const float HalfHeight = 0.5f * View.ViewRect.Height();
+		OutScreenRect = FBox2f(ForceInit);
+		for (const FVector4f& Point : Points)
+		{
+			OutScreenRect += FVector2f(
+				View.ViewRect.Min.X + HalfWidth + Point.X / Point.W * HalfWidth,
+				View.ViewRect.Min.Y + HalfHeight - Point.Y / Point.W * HalfHeight
+			);
+		}
+		return true;
+	}
+
+	// Boxes clipped at the near plane reach far off screen, where pixels get large next to float precision
+	bool IsNearlyEqual(const FBox2f& Actual, const FBox2f& Expected)
+	{
+		const auto IsNear = [](const float A, const float B)
+		{
+			return FMath::IsNearlyEqual(A, B, FMath::Max(0.05f, FMath::Abs(B) * 1.0e-4f));
+		};
+
+		return IsNear(Actual.Min.X, Expected.Min.X) && IsNear(Actual.Min.Y, Expected.Min.Y)
+			&& IsNear(Actual.Max.X, Expected.Max.X) && IsNear(Actual.Max.Y, Expected.Max.Y);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+	FRTSSelectionKernelTest,
+	"OpenRTSCamera.Selection.Kernel",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter
+)
+
+bool FRTSSelectionKernelTest::RunTest(const FString& Parameters)
+{
+	using namespace RTSSelectionKernelTest;
+
+	IConsoleVariable* ParallelThreshold = IConsoleManager::Get().FindConsoleVariable(
+		TEXT("OpenRTSCamera.Selection.ParallelThreshold")
+	);
+	if (!TestNotNull(TEXT("Parallel threshold"), ParallelThreshold))
+	{
+		return false;
+	}
+	const int32 DefaultParallelThreshold = ParallelThreshold->GetInt();
+
+	// Counts around the batch width and the chunk size leave every size of remainder, the last spans several chunks
+	const int32 Counts[] = {1, 3, 4, 5, 1023, 1024, 1025, 3001};
+	const FBox2D Rect(FVector2D(400.0, 200.0), FVector2D(1500.0, 900.0));
+
+	for (const bool bOrthographic : {false, true})
+	{
+		const FRTSSelectionView View = MakeView(bOrthographic);
+
+		for (const int32 Num : Counts)
+		{
+			FRTSSelectionBoundsSoA Bounds;
+			MakeBounds(View, Num, Num, Bounds);
+
+			// Chunks all run on this thread at the default threshold, and across worker threads with it lowered
+			for (const int32 Threshold : {DefaultParallelThreshold, 1})
+			{
+				ParallelThreshold->Set(Threshold, ECVF_SetByCode);
+
+				TArray<FBox2f> ScreenRects;
+				TArray<uint8> Hits;
+				FRTSSelectionKernel::ProjectToScreen(View, Bounds, ScreenRects);
+				FRTSSelectionKernel::TestRect(View, Bounds, Rect, Hits);
+
+				const FString Case = FString::Printf(
+					TEXT("%s view, %d boxes, parallel threshold %d"),
+					bOrthographic ? TEXT("Orthographic") : TEXT("Perspective"),
+					Num,
+					Threshold
+				);
+				if (!TestEqual(Case + TEXT(", screen rect count"), ScreenRects.Num(), Num)
+					|| !TestEqual(Case + TEXT(", hit count"), Hits.Num(), Num))
+				{
+					continue;
+				}
+
+				for (int32 Index = 0; Index < Num; Index++)
+				{
+					const FString What = FString::Printf(TEXT("%s, box %d"), *Case, Index);
+
+					FBox2f Expected;
+					const bool bVisible = ProjectReference(
+						View,
+						FVector(Bounds.CenterX[Index], Bounds.CenterY[Index], Bounds.CenterZ[Index]),
+						FVector(Bounds.ExtentX[Index], Bounds.ExtentY[Index], Bounds.ExtentZ[Index]),
+						Expected
+					);
+
+					if (!TestTrue(What + TEXT(" is visible as in the reference"), ScreenRects[Index].bIsValid == bVisible))
+					{
+						continue;
+					}
+
+					if (!bVisible)
+					{
+						TestFalse(What + TEXT(" is hit behind the view"), Hits[Index] != 0);
+						continue;
+					}
+
+					TestTrue(What + TEXT(" screen rect matches the reference"), IsNearlyEqual(ScreenRects[Index], Expected));
+
+					// Boxes within rounding of the rectangle's edges could go either way
+					const double Overlap = FMath::Min(
+						FMath::Min(Expected.Max.X - Rect.Min.X, Rect.Max.X - Expected.Min.X),
+						FMath::Min(Expected.Max.Y - Rect.Min.Y, Rect.Max.Y - Expected.Min.Y)
+					);
+					if (FMath::Abs(Overlap) > 0.5)
+					{
+						TestTrue(What + TEXT(" is hit as in the reference"), (Hits[Index] != 0) == (Overlap > 0.0));
+					}
+				}
+			}
+		}
+	}
+
+	ParallelThreshold->Set(DefaultParallelThreshold, ECVF_SetByCode);
+	return true;
+}
+
+#endif
@@ -7,22 +7,37 @@
 #include "Camera/CameraComponent.h"
 #include "Components/ActorComponent.h"
 #include "GameFramework/SpringArmComponent.h"
+#include "RTSGroundHeightCache.h"
+#include "WorldCollision.h"
 #include "RTSCamera.generated.h"
 
+class URTSGroundHeightfield;
+
 /**
  * We use these commands so that move camera inputs can be tied to the tick rate of the game.
+ * They're summed as they come in into one velocity, which the camera applies once per tick, so every command that
+ * arrives between two ticks still adds to the move.
  * https://github.com/HeyZoos/OpenRTSCamera/issues/27
  */
-USTRUCT()
-struct FMoveCameraCommand
+struct FMoveCameraCommandBuffer
 {
-	GENERATED_BODY()
-	UPROPERTY()
-	float X = 0;
-	UPROPERTY()
-	float Y = 0;
-	UPROPERTY()
-	float Scale = 0;
+	void Add(const float X, const float Y, const float Scale)
+	{
+		auto Direction = FVector2D(X, Y);
+		Direction.Normalize();
+		this->Velocity += Direction * Scale;
+	}
+
+	// Sum of the commands since the last call, which the move speed and tick time still need applying to
+	FVector2D Consume()
+	{
+		const auto Sum = this->Velocity;
+		this->Velocity = FVector2D::ZeroVector;
+		return Sum;
+	}
+
+private:
+	FVector2D Velocity = FVector2D::ZeroVector;
 };
 
 UCLASS(Blueprintable, ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
@@ -51,6 +66,20 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "RTSCamera")
 	void JumpTo(FVector Position) const;
 
+	/**
+	 * Keeps the cached ground heights under the actor up to date as it moves, for ground that can change at
+	 * runtime such as moving platforms or buildings the camera should ride over
+	 */
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Dynamic Camera Height Settings")
+	void RegisterGroundHeightActor(AActor* Actor);
+
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Dynamic Camera Height Settings")
+	void UnregisterGroundHeightActor(AActor* Actor);
+
+	// Forgets every cached ground height, e.g. after streaming in a level
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Dynamic Camera Height Settings")
+	void InvalidateGroundHeightCache();
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSCamera - Zoom Settings")
 	float MinimumZoomLength;
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSCamera - Zoom Settings")
@@ -102,6 +131,51 @@ public:
 	)
 	float FindGroundTraceLength;
 
+	// Distance between the cached ground height samples, the camera height is filtered between them
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTSCamera - Dynamic Camera Height Settings",
+		meta=(EditCondition="EnableDynamicCameraHeight", ClampMin = "1.0")
+	)
+	float GroundHeightSampleSpacing;
+
+	// Tiles of 8 by 8 samples kept around, the least recently used are dropped first
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTSCamera - Dynamic Camera Height Settings",
+		meta=(EditCondition="EnableDynamicCameraHeight", ClampMin = "4")
+	)
+	int32 GroundHeightCacheMaxTiles;
+
+	// Baked ground heights used instead of traces wherever they cover, taken from the RTSCameraBoundsVolume if unset
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTSCamera - Dynamic Camera Height Settings",
+		meta=(EditCondition="EnableDynamicCameraHeight")
+	)
+	URTSGroundHeightfield* GroundHeightfield;
+
+	// Traces for the ground where the camera is heading without waiting on the result, which is used a tick later
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTSCamera - Dynamic Camera Height Settings",
+		meta=(EditCondition="EnableDynamicCameraHeight")
+	)
+	bool EnableAsyncGroundTraces;
+
+	// How quickly the camera height catches up with asynchronously traced ground, hiding the tick it's late by
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTSCamera - Dynamic Camera Height Settings",
+		meta=(EditCondition="EnableDynamicCameraHeight && EnableAsyncGroundTraces")
+	)
+	float GroundHeightCatchupSpeed;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSCamera - Edge Scroll Settings")
 	bool EnableEdgeScrolling;
 	UPROPERTY(
@@ -149,6 +223,8 @@ protected:
 
 	void RequestMoveCamera(float X, float Y, float Scale);
 	void ApplyMoveCameraCommands();
+	void BeginRootTransformUpdate();
+	void CommitRootTransformUpdate() const;
 
 	UPROPERTY()
 	AActor* Owner;
@@ -174,16 +250,28 @@ private:
 	void BindInputMappingContext() const;
 	void BindInputActions();
 
-	void ConditionallyPerformEdgeScrolling() const;
-	void EdgeScrollLeft() const;
-	void EdgeScrollRight() const;
-	void EdgeScrollUp() const;
-	void EdgeScrollDown() const;
+	void ConditionallyPerformEdgeScrolling();
+	void EdgeScrollLeft();
+	void EdgeScrollRight();
+	void EdgeScrollUp();
+	void EdgeScrollDown();
 
-	void FollowTargetIfSet() const;
+	void FollowTargetIfSet();
 	void SmoothTargetArmLengthToDesiredZoom() const;
 	void ConditionallyKeepCameraAtDesiredZoomAboveGround();
-	void ConditionallyApplyCameraBounds() const;
+	void ConditionallyApplyCameraBounds();
+
+	bool TraceGroundHeight(const FVector2D& Location, double& OutHeight) const;
+	bool CanUseGroundHeightfield(const FVector2D& Location) const;
+	void UpdateAsyncGroundTrace(const FVector2D& RootGroundLocation);
+	void OnGroundHeightActorTransformUpdated(
+		USceneComponent* UpdatedComponent,
+		EUpdateTransformFlags UpdateTransformFlags,
+		ETeleportType Teleport
+	);
+
+	UFUNCTION()
+	void OnGroundHeightActorDestroyed(AActor* DestroyedActor);
 
 	UPROPERTY()
 	FName CameraBlockingVolumeTag;
@@ -197,6 +285,31 @@ private:
 	bool IsDragging;
 	UPROPERTY()
 	FVector2D DragStartLocation;
+	FMoveCameraCommandBuffer MoveCameraCommands;
+	UPROPERTY()
+	float PendingRootYaw;
+	UPROPERTY()
+	FVector DesiredRootLocation;
 	UPROPERTY()
-	TArray<FMoveCameraCommand> MoveCameraCommands;
+	FRotator DesiredRootRotation;
+
+	struct FGroundHeightActor
+	{
+		TWeakObjectPtr<AActor> Actor;
+		FBox Bounds = FBox(ForceInit);
+		FDelegateHandle TransformUpdatedHandle;
+	};
+
+	FRTSGroundHeightCache GroundHeightCache;
+	TArray<FGroundHeightActor> GroundHeightActors;
+
+	// At most one asynchronous ground trace is in flight, its result is kept until the next one lands
+	FTraceHandle AsyncGroundTraceHandle;
+	FVector2D AsyncGroundTraceLocation = FVector2D::ZeroVector;
+	FVector2D LastRootGroundLocation = FVector2D::ZeroVector;
+	double AsyncGroundHeight = 0.0;
+	bool HasLastRootGroundLocation = false;
+	bool HasAsyncGroundTraceResult = false;
+	bool AsyncGroundTraceHit = false;
+	bool IsAsyncGroundTraceStale = true;
 };
@@ -6,10 +6,32 @@
 #include "GameFramework/CameraBlockingVolume.h"
 #include "RTSCameraBoundsVolume.generated.h"
 
+class URTSGroundHeightfield;
+
 UCLASS()
 class OPENRTSCAMERA_API ARTSCameraBoundsVolume : public ACameraBlockingVolume
 {
 	GENERATED_BODY()
 
 	ARTSCameraBoundsVolume();
+
+public:
+	// Ground heights over the volume for dynamic camera height, instead of tracing for them while playing
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "RTSCamera - Ground Heightfield")
+	TObjectPtr<URTSGroundHeightfield> GroundHeightfield;
+
+	UPROPERTY(EditAnywhere, Category = "RTSCamera - Ground Heightfield", meta=(ClampMin = "1.0"))
+	float GroundHeightfieldSampleSpacing;
+
+	UPROPERTY(EditAnywhere, Category = "RTSCamera - Ground Heightfield")
+	TEnumAsByte<ECollisionChannel> GroundHeightfieldCollisionChannel;
+
+	UPROPERTY(EditAnywhere, Category = "RTSCamera - Ground Heightfield")
+	float GroundHeightfieldTraceLength;
+
+#if WITH_EDITOR
+	// Traces the ground over the whole volume into the Ground Heightfield asset, which then needs saving
+	UFUNCTION(CallInEditor, Category = "RTSCamera - Ground Heightfield")
+	void BakeGroundHeightfield();
+#endif
 };
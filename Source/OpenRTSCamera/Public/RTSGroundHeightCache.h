@@ -0,0 +1,56 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Ground heights sampled on a regular grid over world XY, looked up with bilinear filtering.
+ * Samples are grouped into square tiles, which are allocated on first use and evicted least recently used first
+ * once the cache is full. Each sample is only taken the first time a lookup needs it, so a camera that stays still
+ * or pans within already sampled ground doesn't take any.
+ */
+struct OPENRTSCAMERA_API FRTSGroundHeightCache
+{
+	// Takes a ground height sample at the world XY, returning false if there's no ground there
+	using FSampleFunction = TFunctionRef<bool(const FVector2D& Location, double& OutHeight)>;
+
+	// Clears the cache if the spacing changed
+	void Configure(float InSampleSpacing, int32 InMaxTiles);
+
+	/**
+	 * Bilinearly filtered ground height at the world XY, sampling whichever of the four surrounding samples haven't
+	 * been yet. Samples without ground are left out of the filter.
+	 * @param Location
+	 * @param SampleHeight Called for each sample that isn't cached
+	 * @param OutHeight
+	 * @return False if none of the surrounding samples found ground
+	 */
+	bool GetHeight(const FVector2D& Location, FSampleFunction SampleHeight, double& OutHeight);
+
+	// Forgets the samples inside the world space box, so they're taken again when next needed
+	void Invalidate(const FBox& Box);
+	void Reset();
+
+	int32 NumTiles() const { return Tiles.Num(); }
+
+private:
+	// Samples per tile side, so a tile's samples fit in one 64 bit mask
+	static constexpr int32 TileSize = 8;
+
+	struct FTile
+	{
+		double Heights[TileSize * TileSize];
+		uint64 SampledMask = 0;
+		uint64 GroundMask = 0;
+		uint64 LastUsed = 0;
+	};
+
+	FTile& FindOrAddTile(const FIntPoint& TileCoordinates);
+	void EvictLeastRecentlyUsedTile();
+
+	float SampleSpacing = 0.0f;
+	int32 MaxTiles = 0;
+	uint64 UseCounter = 0;
+	TMap<FIntPoint, FTile> Tiles;
+};
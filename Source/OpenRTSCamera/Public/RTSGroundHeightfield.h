@@ -0,0 +1,108 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "RTSGroundHeightfield.generated.h"
+
+// Lowest and highest quantized height within each cell of one mip of a heightfield
+USTRUCT()
+struct OPENRTSCAMERA_API FRTSGroundHeightfieldMip
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FIntPoint Size = FIntPoint::ZeroValue;
+
+	UPROPERTY()
+	TArray<uint16> MinHeights;
+
+	UPROPERTY()
+	TArray<uint16> MaxHeights;
+};
+
+/**
+ * Ground heights baked offline over a rectangle of the world, quantized to 16 bits between the lowest and highest
+ * sample, for worlds whose ground doesn't change so the camera never has to trace over it.
+ * Every mip halves the resolution of the one before and keeps the lowest and highest height of the samples under
+ * each cell, so the height range under any area can be bounded from at most four cells. A cell with any sample
+ * lacking ground has no range at all, since whatever is placed in the hole later would be hit instead.
+ * Baked from an RTSCameraBoundsVolume with its Bake Ground Heightfield button.
+ */
+UCLASS(BlueprintType)
+class OPENRTSCAMERA_API URTSGroundHeightfield : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	// Stored instead of a height where the bake found no ground
+	static constexpr uint16 NoGround = TNumericLimits<uint16>::Max();
+
+	/**
+	 * Samples the ground with a line trace every SampleSpacing over the XY of the area, replacing what was baked
+	 * @param World
+	 * @param Area World space, only its XY matters
+	 * @param SampleSpacing
+	 * @param TraceLength Traces run from this height down to its negative
+	 * @param CollisionChannel
+	 * @return Whether any ground was found
+	 */
+	bool Bake(const UWorld* World, const FBox& Area, float SampleSpacing, float TraceLength, ECollisionChannel CollisionChannel);
+
+	/**
+	 * Quantizes heights already sampled on a grid, replacing what was baked
+	 * @param InOrigin World XY of the first sample
+	 * @param InSampleSpacing
+	 * @param InSize Samples along X and Y, at least two of each
+	 * @param SampledHeights Row major, InSize.X by InSize.Y
+	 * @param SampledGround Set for every sample that found ground, the others' heights are ignored
+	 * @return Whether any ground was found
+	 */
+	bool Build(
+		const FVector2D& InOrigin,
+		float InSampleSpacing,
+		const FIntPoint& InSize,
+		TConstArrayView<double> SampledHeights,
+		const TBitArray<>& SampledGround
+	);
+
+	bool Contains(const FVector2D& Location) const;
+
+	// Bilinearly filtered height, false outside the baked area or where none of the surrounding samples had ground
+	bool GetHeight(const FVector2D& Location, double& OutHeight) const;
+
+	// Conservative bounds of the height anywhere in the area, false if some of it may have no ground under it
+	bool GetHeightRange(const FBox2D& Area, double& OutMinHeight, double& OutMaxHeight) const;
+
+	bool IsBaked() const { return Heights.Num() > 0; }
+
+protected:
+	UPROPERTY(VisibleAnywhere, Category = "Ground Heightfield")
+	FVector2D Origin = FVector2D::ZeroVector;
+
+	UPROPERTY(VisibleAnywhere, Category = "Ground Heightfield")
+	float SampleSpacing = 0.0f;
+
+	UPROPERTY(VisibleAnywhere, Category = "Ground Heightfield")
+	FIntPoint Size = FIntPoint::ZeroValue;
+
+	UPROPERTY(VisibleAnywhere, Category = "Ground Heightfield")
+	double MinHeight = 0.0;
+
+	UPROPERTY(VisibleAnywhere, Category = "Ground Heightfield")
+	double HeightStep = 0.0;
+
+	// Row major, Size.X by Size.Y
+	UPROPERTY()
+	TArray<uint16> Heights;
+
+	// Mip 0 has one cell per 2 by 2 samples
+	UPROPERTY()
+	TArray<FRTSGroundHeightfieldMip> Mips;
+
+private:
+	void BuildMips();
+
+	double Dequantize(const uint16 Height) const { return MinHeight + Height * HeightStep; }
+};
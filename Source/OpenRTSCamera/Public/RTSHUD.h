@@ -4,10 +4,15 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/HUD.h"
+#include "RTSSelectableRegistry.h"
+#include "RTSSelectionKernel.h"
 #include "RTSHUD.generated.h"
 
 DECLARE_MULTICAST_DELEGATE_OneParam(FSelectedActorsSignature, const TArray<AActor*>&);
 DECLARE_MULTICAST_DELEGATE_OneParam(FHoveredActorsSignature, const TArray<AActor*>&);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FHoveredActorsDeltaSignature, const TArray<AActor*>&, const TArray<AActor*>&);
+DECLARE_MULTICAST_DELEGATE_OneParam(FSelectedHandlesSignature, TConstArrayView<FRTSSelectableHandle>);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FHoveredHandlesDeltaSignature, TConstArrayView<FRTSSelectableHandle>, TConstArrayView<FRTSSelectableHandle>);
 
 UCLASS()
 class OPENRTSCAMERA_API ARTSHUD : public AHUD
@@ -21,6 +26,13 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Selection Box")
 	float SelectionBoxThickness;
 
+	// Time between the selection input completing and the selection being broadcast, for the last selection
+	UPROPERTY(BlueprintReadOnly, Category = "Selection Box")
+	float LastSelectionLatencyMs = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Selection Box")
+	int32 LastSelectionLatencyFrames = 0;
+
 	// UPROPERTY()
 	// Delegate for when any and all actors are selected
 	FSelectedActorsSignature OnSelectedActorsDelegate;
@@ -28,6 +40,15 @@ public:
 	// UPROPERTY()
 	// Delegate for when any and all actors are hovered
 	FHoveredActorsSignature OnHoveredActorsDelegate;
+
+	// Delegate for when the box moved but the view didn't, carrying only the actors that entered and left the box
+	FHoveredActorsDeltaSignature OnHoveredActorsDeltaDelegate;
+
+	// Handle counterparts of the delegates above, the only ones that carry registry proxies as those have no actor.
+	// Only selectables in the URTSSelectableRegistry are included
+	FSelectedHandlesSignature OnSelectedHandlesDelegate;
+	FSelectedHandlesSignature OnHoveredHandlesDelegate;
+	FHoveredHandlesDeltaSignature OnHoveredHandlesDeltaDelegate;
 public:
 	ARTSHUD();
 
@@ -48,11 +69,18 @@ public:
 
 	UFUNCTION(BlueprintCallable, Category = "Selection Box")
 	void EndGroupSelection();
+
+	UFUNCTION(BlueprintCallable, Category = "Selection Box")
+	bool ResolveFinalSelection();
 	
 protected:
 	virtual void DrawHUD() override;
 	void DrawSelectionBox();
 	void PerformSelection();
+	void GetSelectablesInSelectionRectangle(TArray<FRTSSelectableHandle>& OutHandles, bool bUseSelectionKernel);
+	bool CanReuseHoverQuery(bool& bOutViewUnchanged);
+	bool PerformIncrementalHoverQuery();
+	FBox2D GetSelectionRectangle() const;
 	
 	UPROPERTY()
 	TObjectPtr<APlayerController> PlayerController = nullptr;
@@ -63,4 +91,55 @@ private:
 	
 	FVector2D SelectionStart;
 	FVector2D SelectionEnd;
+
+	double FinalSelectionRequestTime = 0;
+	uint64 FinalSelectionRequestFrame = 0;
+
+	// Everything a hover query result depends on, if none of it changed the last result is still correct
+	struct FSelectionQueryKey
+	{
+		FVector2D SelectionStart = FVector2D::ZeroVector;
+		FVector2D SelectionEnd = FVector2D::ZeroVector;
+		FVector ViewOrigin = FVector::ZeroVector;
+		FMatrix44f ViewProjection = FMatrix44f::Identity;
+		uint32 RegistryTopologyGeneration = 0;
+		uint32 RegistryMoveCount = 0;
+
+		bool operator==(const FSelectionQueryKey& Other) const
+		{
+			return SelectionStart == Other.SelectionStart
+				&& SelectionEnd == Other.SelectionEnd
+				&& ViewOrigin == Other.ViewOrigin
+				&& ViewProjection == Other.ViewProjection
+				&& RegistryTopologyGeneration == Other.RegistryTopologyGeneration
+				&& RegistryMoveCount == Other.RegistryMoveCount;
+		}
+	};
+
+	FRTSSelectionView SelectionView;
+	bool bHasSelectionView = false;
+
+	FSelectionQueryKey LastHoverQueryKey;
+	bool bHasLastHoverQuery = false;
+	double LastHoverQueryTime = 0;
+
+	// Hover hits of the last query along with the rectangle and registry moves they were found with, so that while
+	// the view stays put only the selectables near the strips the box gained or lost, or that moved, need testing
+	TSet<FRTSSelectableHandle> HoverHits;
+	FBox2D LastHoverRect = FBox2D(ForceInit);
+	uint32 LastHoverMoveCount = 0;
+	bool bHasIncrementalHover = false;
+
+	// Reused between frames so that dragging a box doesn't allocate
+	TArray<AActor*> SelectedActorsBuffer;
+	TArray<FRTSSelectableHandle> SelectedHandlesBuffer;
+	TArray<FRTSSelectableHandle> CandidatesBuffer;
+	FRTSSelectionBoundsSoA CandidateBoundsBuffer;
+	TArray<uint8> CandidateHitsBuffer;
+	TArray<int32> ProjectedIndicesBuffer;
+	TArray<FRTSSelectableHandle> MovedHandlesBuffer;
+	TArray<FRTSSelectableHandle> HoverEnteredBuffer;
+	TArray<FRTSSelectableHandle> HoverLeftBuffer;
+	TArray<AActor*> HoverEnteredActorsBuffer;
+	TArray<AActor*> HoverLeftActorsBuffer;
 };
@@ -0,0 +1,89 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RTSSelectableRegistry.h"
+#include "RTSSelectionKernel.h"
+
+/**
+ * Screen space boxes around every registered selectable as seen from one view, bucketed into a coarse screen grid.
+ * Stays valid while neither the view nor the registry changes, which lets hover queries re-test only the selectables
+ * near the parts of the selection rectangle that moved since the previous frame. While only selectables move, Update
+ * re-projects just those.
+ */
+struct OPENRTSCAMERA_API FRTSScreenProjectionCache
+{
+	bool IsValidFor(const FRTSSelectionView& View, const URTSSelectableRegistry& Registry) const;
+	void Rebuild(const FRTSSelectionView& View, const URTSSelectableRegistry& Registry);
+	void Update(const FRTSSelectionView& View, const URTSSelectableRegistry& Registry);
+	void Invalidate() { bIsValid = false; }
+
+	/**
+	 * Gathers the selectables whose screen boxes touch a grid cell where the two rectangles differ, i.e. every
+	 * selectable that can overlap one rectangle but not the other. May contain duplicates.
+	 * @param OldRect
+	 * @param NewRect
+	 * @param OutIndices Indices into the cache
+	 */
+	void GatherChanged(const FBox2D& OldRect, const FBox2D& NewRect, TArray<int32>& OutIndices) const;
+
+	/**
+	 * Gathers the selectables whose screen boxes overlap the rectangle, each one once
+	 * @param Rect Rectangle in viewport pixels
+	 * @param OutIndices Indices into the cache
+	 */
+	void GatherInRect(const FBox2D& Rect, TArray<int32>& OutIndices) const;
+
+	// Index of the selectable in the cache, INDEX_NONE if it registered after the cache was built
+	int32 FindIndex(const FRTSSelectableHandle& Handle) const
+	{
+		const int32 Index = SlotToIndex.IsValidIndex(Handle.Index) ? SlotToIndex[Handle.Index] : INDEX_NONE;
+		return Index != INDEX_NONE && Handles[Index] == Handle ? Index : INDEX_NONE;
+	}
+
+	bool Overlaps(const int32 Index, const FBox2D& Rect) const
+	{
+		const FBox2f& ScreenRect = ScreenRects[Index];
+		return ScreenRect.bIsValid
+			&& ScreenRect.Max.X >= static_cast<float>(Rect.Min.X) && ScreenRect.Min.X <= static_cast<float>(Rect.Max.X)
+			&& ScreenRect.Max.Y >= static_cast<float>(Rect.Min.Y) && ScreenRect.Min.Y <= static_cast<float>(Rect.Max.Y);
+	}
+
+	const FRTSSelectableHandle& GetHandle(const int32 Index) const { return Handles[Index]; }
+
+	// Invalid when the selectable is behind the camera
+	const FBox2f& GetScreenRect(const int32 Index) const { return ScreenRects[Index]; }
+
+	int32 Num() const { return Handles.Num(); }
+
+private:
+	void BuildGrid();
+	bool GetCellRange(const FBox2D& Rect, FIntPoint& OutMin, FIntPoint& OutMax) const;
+
+	static constexpr int32 CellSize = 64;
+
+	FVector ViewOrigin = FVector::ZeroVector;
+	FMatrix44f ViewProjection = FMatrix44f::Identity;
+	FIntRect ViewRect;
+	uint32 RegistryTopologyGeneration = 0;
+	uint32 RegistryMoveCount = 0;
+	bool bIsValid = false;
+
+	TArray<FRTSSelectableHandle> Handles;
+	FRTSSelectionBoundsSoA Bounds;
+	TArray<FBox2f> ScreenRects;
+
+	// Reused between updates, for the selectables that moved since the last one
+	TArray<FRTSSelectableHandle> MovedHandles;
+	TArray<FBox2f> MovedScreenRects;
+
+	// Cache index by registry slot, which is what handles index
+	TArray<int32> SlotToIndex;
+
+	// Cell contents stored back to back, cell N's indices are CellEntries[CellStarts[N]..CellStarts[N + 1]]
+	FIntPoint GridSize = FIntPoint::ZeroValue;
+	TArray<int32> CellStarts;
+	TArray<int32> CellEntries;
+	TArray<int32> CellCursors;
+};
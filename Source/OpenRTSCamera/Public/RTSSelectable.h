@@ -3,6 +3,8 @@
 #pragma once
 
 #include "InputCoreTypes.h"
+#include "Components/ActorComponent.h"
+#include "RTSSelectableRegistry.h"
 #include "RTSSelectable.generated.h"
 
 UENUM(BlueprintType, Category = "RTS Selection")
@@ -13,8 +15,19 @@ enum class ESelectionState : uint8
 	Hovered		= 2
 };
 
+UENUM(BlueprintType, Category = "RTS Selection")
+enum class ESelectionProxyShape : uint8
+{
+	// Bounds of the owner's colliding components, gathered once when the selectable begins play
+	ComponentBounds	= 0,
+	Sphere			= 1,
+	Capsule			= 2,
+	Box				= 3
+};
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSelectionStateChangedSignature, ESelectionState, SelectionState);
 
+class UMaterialInterface;
 class URTSSelectorSubsystem;
 
 UCLASS(Blueprintable, ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
@@ -25,14 +38,73 @@ class OPENRTSCAMERA_API URTSSelectable : public UActorComponent
 public:
 	UPROPERTY(BlueprintCallable, BlueprintAssignable, Category = "RTS Selection")
 	FOnSelectionStateChangedSignature OnSelectionStateChangedDelegate;
+
+	/**
+	 * Shape that box selection and hover test against instead of the owner's component bounds.
+	 * Offsets and sizes are in the owner's local space. Call RefreshSelectionProxy after changing these at runtime.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTS Selection|Proxy")
+	ESelectionProxyShape ProxyShape = ESelectionProxyShape::ComponentBounds;
+
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTS Selection|Proxy",
+		meta = (EditCondition = "ProxyShape != ESelectionProxyShape::ComponentBounds")
+	)
+	FVector ProxyOffset = FVector::ZeroVector;
+
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTS Selection|Proxy",
+		meta = (EditCondition = "ProxyShape == ESelectionProxyShape::Sphere || ProxyShape == ESelectionProxyShape::Capsule", ClampMin = "0.0")
+	)
+	float ProxyRadius = 50.0f;
+
+	// Includes the hemispheres, as with UCapsuleComponent
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTS Selection|Proxy",
+		meta = (EditCondition = "ProxyShape == ESelectionProxyShape::Capsule", ClampMin = "0.0")
+	)
+	float ProxyHalfHeight = 100.0f;
+
+	UPROPERTY(
+		BlueprintReadWrite,
+		EditAnywhere,
+		Category = "RTS Selection|Proxy",
+		meta = (EditCondition = "ProxyShape == ESelectionProxyShape::Box")
+	)
+	FVector ProxyExtent = FVector(50.0f);
+
+	// Material ARTSSelectionIndicators draws this selectable's indicator with, its default material when not set
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTS Selection|Indicator")
+	TObjectPtr<UMaterialInterface> IndicatorMaterial;
 	
 private:
 	UPROPERTY()
 	ESelectionState CurrentSelectionState = ESelectionState::None;
 
+	// State last broadcast through OnSelectionStateChangedDelegate, changes are batched up until the subsystem flushes
+	ESelectionState NotifiedSelectionState = ESelectionState::None;
+	bool bSelectionStateDirty = false;
+
 	UPROPERTY()
 	URTSSelectorSubsystem* SelectorSubsystem = nullptr;
 
+	UPROPERTY()
+	URTSSelectableRegistry* SelectableRegistry = nullptr;
+
+	FRTSSelectableHandle SelectableHandle;
+
+	FDelegateHandle OwnerTransformUpdatedHandle;
+
+	// Selection proxy cached in the owner's local space
+	FBox ProxyLocalBounds = FBox(FVector::ZeroVector, FVector::ZeroVector);
+	float ProxyLocalSphereRadius = 0.0f;
+
 	UPROPERTY()
 	bool bSelected = false;
 
@@ -46,6 +118,7 @@ public:
 	}
 
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	UFUNCTION(BlueprintCallable, Category = "RTS Selection")
 	void BindToActorMouseEvents(AActor* Owner);
@@ -59,6 +132,15 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "RTS Selection")
 	ESelectionState GetSelectionState() const;
 
+	const FRTSSelectableHandle& GetSelectableHandle() const { return SelectableHandle; }
+
+	UFUNCTION(BlueprintCallable, Category = "RTS Selection")
+	void RefreshSelectionProxy();
+
+	const FBox& GetSelectionProxyLocalBounds() const { return ProxyLocalBounds; }
+	float GetSelectionProxyLocalSphereRadius() const { return ProxyLocalSphereRadius; }
+	FBox GetSelectionProxyWorldBounds() const;
+
 	UFUNCTION(BlueprintCallable, Category = "RTS Selection")
 	void Select();
 
@@ -70,10 +152,20 @@ public:
 
 	UFUNCTION(BlueprintCallable, Category = "RTS Selection")
 	void HoverEnd();
+
+	/**
+	 * Called by the selector subsystem when it flushes this frame's selection state changes.
+	 * Returns whether the state differs from the one last broadcast, remembering it as broadcast if so.
+	 */
+	bool ConsumeSelectionStateChange();
 private:
 	UFUNCTION()
 	void OnBeginCursorOver(AActor* TouchedActor = nullptr);
 	
 	UFUNCTION()
 	void OnEndCursorOver(AActor* TouchedActor = nullptr);
+
+	void CacheSelectionProxy();
+	void NotifySelectionStateChanged();
+	void OnOwnerTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
 };
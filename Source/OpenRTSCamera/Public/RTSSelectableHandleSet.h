@@ -0,0 +1,93 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RTSSelectableRegistry.h"
+
+/**
+ * Sparse set of selectable handles.
+ * Handles are stored densely for iteration, with a sparse array indexed by registry slot pointing into the dense one,
+ * so adding, removing and lookups are O(1) without hashing. A handle whose slot was reused by another selectable
+ * never matches, and is replaced when the new occupant is added.
+ */
+struct OPENRTSCAMERA_API FRTSSelectableHandleSet
+{
+	bool Contains(const FRTSSelectableHandle& Handle) const
+	{
+		const int32 DenseIndex = Sparse.IsValidIndex(Handle.Index) ? Sparse[Handle.Index] : INDEX_NONE;
+		return DenseIndex != INDEX_NONE && Dense[DenseIndex] == Handle;
+	}
+
+	// Returns false if the handle was already in the set, or is unset
+	bool Add(const FRTSSelectableHandle& Handle)
+	{
+		if (!Handle.IsSet())
+		{
+			return false;
+		}
+
+		if (Handle.Index >= Sparse.Num())
+		{
+			const int32 OldNum = Sparse.Num();
+			Sparse.SetNumUninitialized(Handle.Index + 1, false);
+			for (int32 Index = OldNum; Index < Sparse.Num(); Index++)
+			{
+				Sparse[Index] = INDEX_NONE;
+			}
+		}
+
+		const int32 DenseIndex = Sparse[Handle.Index];
+		if (DenseIndex != INDEX_NONE)
+		{
+			if (Dense[DenseIndex] == Handle)
+			{
+				return false;
+			}
+
+			// A previous occupant of the slot was never removed, the new one takes its place
+			Dense[DenseIndex] = Handle;
+			return true;
+		}
+
+		Sparse[Handle.Index] = Dense.Add(Handle);
+		return true;
+	}
+
+	// Returns false if the handle wasn't in the set
+	bool Remove(const FRTSSelectableHandle& Handle)
+	{
+		if (!Contains(Handle))
+		{
+			return false;
+		}
+
+		const int32 DenseIndex = Sparse[Handle.Index];
+		const FRTSSelectableHandle Last = Dense.Last();
+		Sparse[Last.Index] = DenseIndex;
+		Dense[DenseIndex] = Last;
+		Dense.Pop(false);
+		Sparse[Handle.Index] = INDEX_NONE;
+		return true;
+	}
+
+	void Reset()
+	{
+		for (const FRTSSelectableHandle& Handle : Dense)
+		{
+			Sparse[Handle.Index] = INDEX_NONE;
+		}
+		Dense.Reset();
+	}
+
+	int32 Num() const { return Dense.Num(); }
+
+	TConstArrayView<FRTSSelectableHandle> GetHandles() const { return Dense; }
+
+	TArray<FRTSSelectableHandle>::RangedForConstIteratorType begin() const { return Dense.begin(); }
+	TArray<FRTSSelectableHandle>::RangedForConstIteratorType end() const { return Dense.end(); }
+
+private:
+	TArray<FRTSSelectableHandle> Dense;
+	TArray<int32> Sparse;
+};
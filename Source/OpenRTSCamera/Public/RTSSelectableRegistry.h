@@ -0,0 +1,202 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "RTSSelectableRegistry.generated.h"
+
+class APlayerController;
+class URTSSelectable;
+struct FMinimalViewInfo;
+struct FRTSSelectionBoundsSoA;
+
+/**
+ * Stable reference to a selectable registered with the URTSSelectableRegistry.
+ * Slots are reused once a selectable unregisters, the generation tells a stale handle apart from the new occupant.
+ */
+USTRUCT()
+struct OPENRTSCAMERA_API FRTSSelectableHandle
+{
+	GENERATED_BODY()
+
+	int32 Index = INDEX_NONE;
+	uint32 Generation = 0;
+
+	bool IsSet() const { return Index != INDEX_NONE; }
+
+	bool operator==(const FRTSSelectableHandle& Other) const
+	{
+		return Index == Other.Index && Generation == Other.Generation;
+	}
+
+	bool operator!=(const FRTSSelectableHandle& Other) const
+	{
+		return !(*this == Other);
+	}
+
+	friend uint32 GetTypeHash(const FRTSSelectableHandle& Handle)
+	{
+		return HashCombine(::GetTypeHash(Handle.Index), ::GetTypeHash(Handle.Generation));
+	}
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSelectableUnregisteredSignature, const FRTSSelectableHandle&);
+
+/**
+ * Registry of every live URTSSelectable in the world.
+ * Selectables are kept in a dense array addressed through generation checked handles, with a map from owning actor
+ * to handle so selection results can be resolved without searching actor components. The registry also buckets
+ * selectables into a uniform grid over world XY, so box selection only has to look at the cells underneath the
+ * ground footprint of the selection rectangle.
+ * Units without actors, such as Mass entities, register as proxies: just a bounding sphere and a user value, no
+ * component and no UObject. They take part in every query and in the selection sets, but resolve to no selectable
+ * or actor, so their owners follow selection through the native handle delegates instead.
+ */
+UCLASS()
+class OPENRTSCAMERA_API URTSSelectableRegistry : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Broadcast as a selectable unregisters, while its handle still resolves
+	FOnSelectableUnregisteredSignature OnSelectableUnregistered;
+
+	FRTSSelectableHandle RegisterSelectable(URTSSelectable* Selectable);
+	void UnregisterSelectable(const FRTSSelectableHandle& Handle);
+	void UpdateSelectable(const FRTSSelectableHandle& Handle);
+	void RefreshSelectableBounds(const FRTSSelectableHandle& Handle);
+
+	/**
+	 * Registers a selectable with no actor or component behind it
+	 * @param Center World space center of its bounding sphere
+	 * @param Radius 
+	 * @param UserData Whatever the owner needs to find the unit again from its handle, e.g. a packed entity handle
+	 */
+	FRTSSelectableHandle RegisterProxy(const FVector& Center, float Radius, uint64 UserData = 0);
+
+	// Proxies don't follow anything, their owner moves them. Unregister them with UnregisterSelectable
+	void UpdateProxy(const FRTSSelectableHandle& Handle, const FVector& Center);
+	void UpdateProxies(TConstArrayView<FRTSSelectableHandle> Handles, TConstArrayView<FVector> Centers);
+
+	bool IsValid(const FRTSSelectableHandle& Handle) const;
+	URTSSelectable* Resolve(const FRTSSelectableHandle& Handle) const;
+	AActor* ResolveActor(const FRTSSelectableHandle& Handle) const;
+	FRTSSelectableHandle FindHandle(const AActor* Actor) const;
+	URTSSelectable* FindSelectable(const AActor* Actor) const;
+	bool IsProxy(const FRTSSelectableHandle& Handle) const;
+	uint64 GetProxyUserData(const FRTSSelectableHandle& Handle) const;
+
+	// World space box around the selection proxy, the one the selection kernel tests
+	FBox GetBoundingBox(const FRTSSelectableHandle& Handle) const;
+
+	void GatherInFootprint(const FBox2D& Footprint, TArray<FRTSSelectableHandle>& OutHandles) const;
+	void GatherAll(TArray<FRTSSelectableHandle>& OutHandles) const;
+	void GatherOfClass(const UClass* Class, TArray<FRTSSelectableHandle>& OutHandles) const;
+
+	// World space area queries, these only need the registry so they work without a HUD or a local player
+	void GatherInCircle(const FVector2D& Center, double Radius, TArray<FRTSSelectableHandle>& OutHandles) const;
+	void GatherInConvexPolygon(TConstArrayView<FVector2D> Polygon, TArray<FRTSSelectableHandle>& OutHandles) const;
+	void PackBounds(TConstArrayView<FRTSSelectableHandle> Handles, FRTSSelectionBoundsSoA& OutBounds) const;
+
+	bool GetScreenRectGroundFootprint(
+		const APlayerController* PlayerController,
+		const FVector2D& FirstPoint,
+		const FVector2D& SecondPoint,
+		FBox2D& OutFootprint
+	) const;
+
+	bool GetViewRectGroundPolygon(
+		const FMinimalViewInfo& ViewInfo,
+		const FIntPoint& ViewportSize,
+		const FVector2D& FirstPoint,
+		const FVector2D& SecondPoint,
+		TArray<FVector2D>& OutPolygon
+	) const;
+
+	int32 Num() const { return Entries.Num(); }
+
+	// Bumped whenever a selectable registers, unregisters or moves, so cached query results can tell they're stale
+	uint32 GetGeneration() const { return Generation; }
+
+	// Bumped only when a selectable registers or unregisters, handles and slots stay put until it changes
+	uint32 GetTopologyGeneration() const { return TopologyGeneration; }
+
+	// Number of moves so far, pass it back to GatherMovedSince to find what moved after this point
+	uint32 GetMoveCount() const { return MoveCount; }
+
+	bool GatherMovedSince(uint32 InMoveCount, TArray<FRTSSelectableHandle>& OutHandles) const;
+
+protected:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+private:
+	struct FSlot
+	{
+		uint32 Generation = 0;
+		int32 EntryIndex = INDEX_NONE;
+	};
+
+	struct FEntry
+	{
+		// Selectables unregister on EndPlay, so raw pointers never outlive the objects they point to
+		URTSSelectable* Selectable = nullptr;
+		AActor* Actor = nullptr;
+		int32 SlotIndex = INDEX_NONE;
+
+		// World space box around the selectable's selection proxy, what the selection kernel tests
+		FVector Center = FVector::ZeroVector;
+		FVector Extent = FVector::ZeroVector;
+
+		// Bounding sphere around the selection proxy, for grid culling and the world space queries
+		float SphereRadius = 0.0f;
+		FIntPoint Cell = FIntPoint::ZeroValue;
+
+		// Position of the slot in its owner class's bucket, proxies have no class
+		int32 ClassBucketIndex = INDEX_NONE;
+
+		// Only set for proxies, which have no selectable or actor
+		uint64 UserData = 0;
+	};
+
+	const FEntry* FindEntry(const FRTSSelectableHandle& Handle) const;
+	FRTSSelectableHandle MakeHandle(int32 SlotIndex) const;
+
+	template <typename PredicateType>
+	void GatherInAreaWhere(const FBox2D& Area, TArray<FRTSSelectableHandle>& OutHandles, PredicateType Predicate) const;
+
+	void CacheBounds(FEntry& Entry) const;
+	void UpdateCell(FEntry& Entry);
+	FIntPoint GetCell(const FVector& Location) const;
+	void AddToCell(int32 SlotIndex, const FIntPoint& Cell);
+	void RemoveFromCell(int32 SlotIndex, const FIntPoint& Cell);
+	void ExpandBounds(const FEntry& Entry);
+
+	float CellSize = 2000.0f;
+	uint32 Generation = 0;
+	uint32 TopologyGeneration = 0;
+
+	// Slots of the last MovedSlots.Num() moves, oldest first, a slot appears once for every time it moved
+	TArray<int32> MovedSlots;
+	uint32 MoveCount = 0;
+
+	TArray<FSlot> Slots;
+	TArray<int32> FreeSlots;
+	TArray<FEntry> Entries;
+	TMap<const AActor*, FRTSSelectableHandle> ActorToHandle;
+
+	// Cells hold slot indices as those stay put while entries are swapped around the dense array
+	TMap<FIntPoint, TArray<int32>> Cells;
+
+	// Slot indices by the exact class of the owning actor
+	TMap<const UClass*, TArray<int32>> ClassBuckets;
+
+	// Conservative bounds over everything ever registered, only reset once the registry empties
+	FIntPoint MinOccupiedCell = FIntPoint::ZeroValue;
+	FIntPoint MaxOccupiedCell = FIntPoint::ZeroValue;
+	float MaxRadius = 0.0f;
+	double MinZ = 0.0;
+	double MaxZ = 0.0;
+	bool bHasBounds = false;
+};
@@ -0,0 +1,80 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "RTSSelectableRegistry.h"
+#include "RTSSelectionIndicators.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UMaterialInterface;
+class UStaticMesh;
+class URTSSelectable;
+
+/**
+ * Draws a ring under every hovered or selected selectable using one instanced static mesh per indicator material,
+ * so thousands of indicators cost a draw call per material rather than a component each.
+ * Instances are pooled, showing and hiding an indicator only writes its instance transform and custom data.
+ * The selection state is written to custom data 0 (as ESelectionState) and the ring radius to custom data 1,
+ * indicator materials read them through PerInstanceCustomData.
+ * Spawned by URTSSelectorSubsystem::SpawnSelectionIndicators.
+ */
+UCLASS(Blueprintable)
+class OPENRTSCAMERA_API ARTSSelectionIndicators : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Mesh each indicator is drawn with, scaled so that IndicatorMeshSize covers the selectable's proxy
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "RTS Selection|Indicator")
+	TObjectPtr<UStaticMesh> IndicatorMesh;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "RTS Selection|Indicator", meta = (ClampMin = "1.0"))
+	float IndicatorMeshSize = 100.0f;
+
+	// Used for selectables that don't set an IndicatorMaterial of their own
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "RTS Selection|Indicator")
+	TObjectPtr<UMaterialInterface> DefaultIndicatorMaterial;
+
+	// Height above the bottom of the selection proxy the indicator is drawn at
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "RTS Selection|Indicator")
+	float IndicatorHeightOffset = 2.0f;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "RTS Selection|Indicator", meta = (ClampMin = "0.0"))
+	float IndicatorRadiusScale = 1.2f;
+
+public:
+	ARTSSelectionIndicators();
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	void SetRegistry(URTSSelectableRegistry* NewRegistry);
+	void OnSelectionStatesChanged(TConstArrayView<URTSSelectable*> Selectables);
+
+private:
+	struct FIndicatorInstance
+	{
+		int32 Batch = INDEX_NONE;
+		int32 Instance = INDEX_NONE;
+	};
+
+	int32 FindOrAddBatch(UMaterialInterface* Material);
+	void ShowIndicator(const URTSSelectable* Selectable, const FIndicatorInstance& Indicator);
+	void HideIndicator(const FIndicatorInstance& Indicator);
+	FTransform GetIndicatorTransform(const URTSSelectable* Selectable, float& OutRadius) const;
+
+	UPROPERTY()
+	TObjectPtr<URTSSelectableRegistry> SelectableRegistry;
+
+	// One per indicator material, indexed the same as BatchMaterials and FreeInstances
+	UPROPERTY()
+	TArray<TObjectPtr<UInstancedStaticMeshComponent>> Batches;
+
+	TArray<const UMaterialInterface*> BatchMaterials;
+	TArray<TArray<int32>> FreeInstances;
+	TBitArray<> DirtyBatches;
+
+	TMap<FRTSSelectableHandle, FIndicatorInstance> Indicators;
+	uint32 LastRegistryGeneration = 0;
+};
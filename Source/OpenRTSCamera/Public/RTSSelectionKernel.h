@@ -0,0 +1,92 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class APlayerController;
+
+/**
+ * World space boxes around the selection proxies of selectables, packed as structure of arrays so they can be
+ * projected in SIMD batches. Centers stay in double precision, the kernel rebases them on the view origin before
+ * dropping to float.
+ */
+struct OPENRTSCAMERA_API FRTSSelectionBoundsSoA
+{
+	TArray<double> CenterX;
+	TArray<double> CenterY;
+	TArray<double> CenterZ;
+	TArray<float> ExtentX;
+	TArray<float> ExtentY;
+	TArray<float> ExtentZ;
+
+	int32 Num() const { return ExtentX.Num(); }
+
+	void Reset()
+	{
+		CenterX.Reset();
+		CenterY.Reset();
+		CenterZ.Reset();
+		ExtentX.Reset();
+		ExtentY.Reset();
+		ExtentZ.Reset();
+	}
+
+	void Add(const FVector& Center, const FVector& Extent)
+	{
+		CenterX.Add(Center.X);
+		CenterY.Add(Center.Y);
+		CenterZ.Add(Center.Z);
+		ExtentX.Add(static_cast<float>(Extent.X));
+		ExtentY.Add(static_cast<float>(Extent.Y));
+		ExtentZ.Add(static_cast<float>(Extent.Z));
+	}
+};
+
+/**
+ * The parts of a player's view needed to project world positions to viewport pixels.
+ * ViewProjection is relative to ViewOrigin, keeping float precision on large worlds.
+ */
+struct OPENRTSCAMERA_API FRTSSelectionView
+{
+	FVector ViewOrigin = FVector::ZeroVector;
+	FMatrix44f ViewProjection = FMatrix44f::Identity;
+	FIntRect ViewRect;
+
+	bool Init(const APlayerController* PlayerController);
+};
+
+/**
+ * Projects packed selectable bounds to the screen and tests them against a selection rectangle.
+ * The screen box of a selectable is the box around the projections of its eight corners, which contains everything
+ * inside the box on screen. Boxes are projected four at a time with vector intrinsics and large inputs are split
+ * across worker threads. Boxes crossing the near plane are clipped to it first, so they still count where they're
+ * visible.
+ */
+struct OPENRTSCAMERA_API FRTSSelectionKernel
+{
+	/**
+	 * @param View View to project with
+	 * @param Bounds Packed bounding boxes
+	 * @param Rect Selection rectangle in viewport pixels
+	 * @param OutHits One entry per box, non zero when the projected box overlaps the rectangle
+	 */
+	static void TestRect(
+		const FRTSSelectionView& View,
+		const FRTSSelectionBoundsSoA& Bounds,
+		const FBox2D& Rect,
+		TArray<uint8>& OutHits
+	);
+
+	/**
+	 * @param View View to project with
+	 * @param Bounds Packed bounding boxes
+	 * @param OutScreenRects One entry per box, the screen space box around the projected box in viewport pixels,
+	 * or an invalid box when all of it is behind the near plane
+	 */
+	static void ProjectToScreen(
+		const FRTSSelectionView& View,
+		const FRTSSelectionBoundsSoA& Bounds,
+		TArray<FBox2f>& OutScreenRects
+	);
+};
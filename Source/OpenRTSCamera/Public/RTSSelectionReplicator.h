@@ -0,0 +1,127 @@
+// Copyright 2024 Ryan Sweeney All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Engine/NetSerialization.h"
+#include "UObject/ObjectKey.h"
+#include "RTSSelectableRegistry.h"
+#include "RTSSelectionReplicator.generated.h"
+
+class URTSSelectorSubsystem;
+
+/**
+ * One update of a client's selection, sent to the server.
+ * Actors are written as their network GUIDs through the package map, so only replicated actors can be sent.
+ */
+USTRUCT()
+struct OPENRTSCAMERA_API FRTSSelectionDelta
+{
+	GENERATED_BODY()
+
+	// Increments by one every update, a gap on the server means an update was lost
+	uint16 Sequence = 0;
+
+	// The server clears its copy of the selection before applying Added
+	bool bReset = false;
+
+	TArray<TObjectPtr<AActor>> Added;
+	TArray<TObjectPtr<AActor>> Removed;
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FRTSSelectionDelta> : public TStructOpsTypeTraitsBase2<FRTSSelectionDelta>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnReplicatedSelectionChangedSignature);
+
+/**
+ * Mirrors the owning player's selection to the server, so the server can validate orders against what the player
+ * actually has selected rather than a list of actors sent along with every order.
+ * Add it to the player controller. On the owning client it sends what changed in the selector subsystem's selection
+ * as unreliable, size capped deltas. A gap in the sequence on the server makes it ask for the whole selection again.
+ * Selectables are sent as their replicated owning actors, so proxies registered without an actor, and actors that
+ * don't replicate, never reach the server. Orders for those have to be validated some other way.
+ */
+UCLASS(Blueprintable, ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class OPENRTSCAMERA_API URTSSelectionReplicator : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Server only, broadcast after an update from the client was applied
+	UPROPERTY(BlueprintAssignable, Category = "RTS Selection|Replication")
+	FOnReplicatedSelectionChangedSignature OnReplicatedSelectionChangedDelegate;
+
+	/**
+	 * Upper bound on the size of each update, selections bigger than this are sent over several ticks.
+	 * Only exceeded by an update carrying a single actor that's bigger on its own.
+	 */
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTS Selection|Replication", meta = (ClampMin = "16"))
+	int32 MaxBytesPerUpdate = 128;
+
+	// How often an empty update is sent while the selection isn't changing, so a lost last update is noticed
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTS Selection|Replication", meta = (ClampMin = "0.1"))
+	float HeartbeatInterval = 1.0f;
+
+	// How long the server waits for a requested resync before asking again
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTS Selection|Replication", meta = (ClampMin = "0.1"))
+	float ResyncRetryInterval = 1.0f;
+
+public:
+	URTSSelectionReplicator();
+
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Server only, the selection as last received from the client
+	UFUNCTION(BlueprintPure, Category = "RTS Selection|Replication")
+	TArray<AActor*> GetReplicatedSelection() const;
+
+	// Server only, whether the client has the actor selected, for validating orders
+	UFUNCTION(BlueprintPure, Category = "RTS Selection|Replication")
+	bool IsReplicatedSelected(const AActor* Actor) const;
+
+protected:
+	UFUNCTION(Server, Unreliable)
+	void ServerUpdateSelection(const FRTSSelectionDelta& Delta);
+
+	UFUNCTION(Client, Reliable)
+	void ClientRequestSelectionResync();
+
+private:
+	void OnSelectionChanged(TConstArrayView<FRTSSelectableHandle> Added, TConstArrayView<FRTSSelectableHandle> Removed);
+	void QueueResync();
+	void SendPendingUpdate();
+	void RequestResync();
+
+	UPROPERTY()
+	TObjectPtr<URTSSelectorSubsystem> SelectorSubsystem;
+
+	UPROPERTY()
+	TObjectPtr<URTSSelectableRegistry> SelectableRegistry;
+
+	// Client side changes not yet sent, an actor is never in both
+	TSet<TWeakObjectPtr<AActor>> PendingAdded;
+	TSet<TWeakObjectPtr<AActor>> PendingRemoved;
+	bool bPendingReset = false;
+	uint16 NextSequence = 0;
+	float TimeSinceLastSend = 0.0f;
+
+	// Server side copy of the client's selection
+	TSet<TObjectKey<AActor>> ReplicatedSelection;
+	uint16 ExpectedSequence = 0;
+	bool bAwaitingResync = true;
+	double LastResyncRequestTime = -UE_BIG_NUMBER;
+
+	FDelegateHandle SelectionChangedHandle;
+};
@@ -6,7 +6,12 @@
 #include "InputAction.h"
 #include "InputMappingContext.h"
 #include "RTSHUD.h"
+#include "RTSScreenProjectionCache.h"
 #include "RTSSelectable.h"
+#include "RTSSelectableHandleSet.h"
+#include "RTSSelectableRegistry.h"
+#include "RTSSelectionIndicators.h"
+#include "Camera/CameraTypes.h"
 #include "Components/ActorComponent.h"
 #include "RTSSelectorSubsystem.generated.h"
 
@@ -14,6 +19,9 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnActorsSelectedSignature, const TA
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnActorsDeselectedSignature, const TArray<AActor*>&, DeselectedActors);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnActorsHoverStartSignature, const TArray<AActor*>&, HoverStartActors);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnActorsHoverEndSignature, const TArray<AActor*>&, HoverEndActors);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnSelectionChangedSignature, TConstArrayView<FRTSSelectableHandle>, TConstArrayView<FRTSSelectableHandle>);
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnHoverChangedSignature, TConstArrayView<FRTSSelectableHandle>, TConstArrayView<FRTSSelectableHandle>);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSelectionStatesChangedSignature, TConstArrayView<URTSSelectable*>);
 
 /**
  * 
@@ -29,6 +37,8 @@ class OPENRTSCAMERA_API URTSSelectorSubsystem : public ULocalPlayerSubsystem
 	bool bGroupSelecting = false;
 	FVector2D StartPosition = FVector2D::ZeroVector;
 	double SelectStartTime = 0;
+	FRTSSelectableHandle LastClickedHandle;
+	double LastClickTime = 0;
 	
 public:
 	// BlueprintReadWrite allows access and modification in Blueprints
@@ -44,12 +54,6 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSCamera - Inputs")
 	TObjectPtr<UInputAction> LeftShift;
 	
-	UPROPERTY(BlueprintReadOnly, Category = "RTSCamera - Selection")
-	TSet<URTSSelectable*> SelectedSet;
-
-	UPROPERTY(BlueprintReadOnly, Category = "RTSCamera - Selection")
-	TSet<URTSSelectable*> HoveredSet;
-
 	UPROPERTY(BlueprintAssignable, Category = "RTSCamera - Selection")
 	FOnActorsSelectedSignature OnActorsSelectedDelegate;
 
@@ -61,6 +65,27 @@ public:
 
 	UPROPERTY(BlueprintAssignable, Category = "RTSCamera - Selection")
 	FOnActorsHoverEndSignature OnActorsHoverEndDelegate;
+
+	// Native counterparts of the delegates above, without reflection and with both sides of each change at once.
+	// Receive the handles that were added and removed, resolve them through the URTSSelectableRegistry
+	FOnSelectionChangedSignature OnSelectionChangedDelegate;
+	FOnHoverChangedSignature OnHoverChangedDelegate;
+
+	// Clicking the same unit twice within this many seconds selects every unit of its type on screen
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSCamera - Selection", meta = (ClampMin = "0.0"))
+	float DoubleClickTime = 0.3f;
+
+	// Whether storing a unit in a control group takes it out of every other group, as in most RTS games
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSCamera - Control Groups")
+	bool bControlGroupsSteal = true;
+
+	// Whether the Blueprint delegates above mirror the native ones, turn off when only native code listens
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "RTSCamera - Selection")
+	bool bBroadcastBlueprintDelegates = true;
+
+	// Every selectable whose selection state changed this frame, once each, broadcast at the end of the frame
+	// before each selectable's own OnSelectionStateChangedDelegate
+	FOnSelectionStatesChangedSignature OnSelectionStatesChangedDelegate;
 	
 public:
 	URTSSelectorSubsystem();
@@ -75,13 +100,68 @@ public:
 	// UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
 	// void ClearHoveredActors();
 	
-	// Function to handle selected actors, can be overridden in Blueprints
+	// Built from the handle sets on every call, proxies resolve to no selectable so they're left out
+	UFUNCTION(BlueprintPure, Category = "RTSCamera - Selection")
+	TArray<URTSSelectable*> GetSelected() const;
+
+	UFUNCTION(BlueprintPure, Category = "RTSCamera - Selection")
+	TArray<URTSSelectable*> GetHovered() const;
+
+	// Include proxies, iterate these or their GetHandles() view when reading the selection every frame
+	const FRTSSelectableHandleSet& GetSelectedHandles() const { return SelectedHandles; }
+	const FRTSSelectableHandleSet& GetHoveredHandles() const { return HoveredHandles; }
+
+	/**
+	 * Appends the selected selectables to the array, which the caller can reset and reuse from frame to frame
+	 * @param OutSelectables 
+	 */
+	void GetSelectedSelectables(TArray<URTSSelectable*>& OutSelectables) const { ResolveSelectables(SelectedHandles, OutSelectables); }
+	void GetHoveredSelectables(TArray<URTSSelectable*>& OutSelectables) const { ResolveSelectables(HoveredHandles, OutSelectables); }
+
 	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
 	void ProcessSelectedActors(const TArray<AActor*>& NewSelectedActors);
 
 	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
 	void ProcessHoveredActors(const TArray<AActor*>& NewHoveredActors);
 
+	// Handle counterparts of the above, the only way registry proxies without an actor get selected or hovered
+	void ProcessSelectedHandles(TConstArrayView<FRTSSelectableHandle> NewSelectedHandles);
+	void ProcessHoveredHandles(TConstArrayView<FRTSSelectableHandle> NewHoveredHandles);
+	void ProcessHoveredHandlesDelta(
+		TConstArrayView<FRTSSelectableHandle> HoverStartedHandles,
+		TConstArrayView<FRTSSelectableHandle> HoverEndedHandles
+	);
+
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
+	void ProcessHoveredActorsDelta(const TArray<AActor*>& HoverStartedActors, const TArray<AActor*>& HoverEndedActors);
+
+	/**
+	 * Selects every selectable on screen whose owner is of exactly the same class as the given actor
+	 * @param Actor 
+	 * @param bAppend Add them to the selection rather than replacing it
+	 */
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
+	void SelectAllOfTypeOnScreen(const AActor* Actor, bool bAppend = false);
+
+	// Replaces the control group with the current selection
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Control Groups")
+	void StoreControlGroup(int32 GroupIndex);
+
+	// Adds the current selection to the control group
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Control Groups")
+	void AddToControlGroup(int32 GroupIndex);
+
+	/**
+	 * Selects the units in the control group, only units whose selection changes are notified
+	 * @param GroupIndex 
+	 * @param bAppend Add the group to the selection rather than replacing it
+	 */
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Control Groups")
+	void RecallControlGroup(int32 GroupIndex, bool bAppend = false);
+
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Control Groups")
+	TArray<AActor*> GetControlGroupActors(int32 GroupIndex);
+
 	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
 	void SingleSelectEnd(const FInputActionValue& Value);
 	
@@ -107,12 +187,93 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
 	void RegisterHoverEnd(URTSSelectable* Selectable);
 
+	/**
+	 * Screen space boxes of every registered selectable as seen by this player, shared with the selection box so
+	 * gameplay code placing things over units doesn't have to project them again. A snapshot taken at most once a
+	 * frame that re-projects only the selectables that moved since the last one, and everything only when the view
+	 * changed or selectables came or went. Selectables moving later in the frame show up the next frame.
+	 * Returns null when there's no view to project with.
+	 */
+	const FRTSScreenProjectionCache* GetScreenProjections();
+
+	// The screen projections if they're already up to date for the given view, without rebuilding them
+	const FRTSScreenProjectionCache* FindScreenProjections(const FRTSSelectionView& View) const;
+
+	/**
+	 * Spawns the instanced indicators drawn under hovered and selected selectables, replacing any spawned before.
+	 * Needs a registered player controller.
+	 * @param IndicatorsClass Subclass to spawn, to change the mesh or materials the indicators are drawn with
+	 */
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
+	ARTSSelectionIndicators* SpawnSelectionIndicators(TSubclassOf<ARTSSelectionIndicators> IndicatorsClass);
+
+	// Queues a selectable's state change for the end of frame flush, called by the selectable
+	void MarkSelectionStateDirty(URTSSelectable* Selectable);
+
+	// Screen space box around the actor's selection proxy in viewport pixels, false if it isn't selectable or on screen
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Selection")
+	bool GetSelectableScreenRect(const AActor* Actor, FBox2D& OutScreenRect);
+
+	/*
+	 * World space area queries. These are static and only go through the world's selectable registry, as there's no
+	 * local player (and so no selector subsystem) on a dedicated server, in headless simulations or for AI.
+	 * The Blueprint ones only return selectables with an actor, proxies are only found by the handle versions.
+	 */
+
+	// Selectables whose bounds overlap a vertical cylinder around the center, e.g. for area abilities
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Queries", meta = (WorldContext = "WorldContextObject"))
+	static TArray<AActor*> GetSelectablesInCircle(const UObject* WorldContextObject, FVector Center, float Radius);
+
+	// Selectables whose bounds overlap a vertical prism over the convex polygon's world XY corners
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Queries", meta = (WorldContext = "WorldContextObject"))
+	static TArray<AActor*> GetSelectablesInConvexPolygon(const UObject* WorldContextObject, const TArray<FVector2D>& Polygon);
+
+	/**
+	 * Selectables on the ground under a screen space box of any view, so a server can resolve a box selection from
+	 * the view a client sent rather than trusting the client's list of units
+	 * @param WorldContextObject 
+	 * @param ViewInfo View the box was drawn in, with its aspect ratio matching the viewport
+	 * @param ViewportSize 
+	 * @param FirstPoint Screen space corner
+	 * @param SecondPoint Opposite screen space corner
+	 */
+	UFUNCTION(BlueprintCallable, Category = "RTSCamera - Queries", meta = (WorldContext = "WorldContextObject"))
+	static TArray<AActor*> GetSelectablesInViewRectOnGround(
+		const UObject* WorldContextObject,
+		const FMinimalViewInfo& ViewInfo,
+		FIntPoint ViewportSize,
+		FVector2D FirstPoint,
+		FVector2D SecondPoint
+	);
+
+	// Handle counterparts of the queries above, which include registry proxies. Append to OutHandles
+	static void GetSelectableHandlesInCircle(
+		const UObject* WorldContextObject,
+		const FVector& Center,
+		float Radius,
+		TArray<FRTSSelectableHandle>& OutHandles
+	);
+	static void GetSelectableHandlesInConvexPolygon(
+		const UObject* WorldContextObject,
+		TConstArrayView<FVector2D> Polygon,
+		TArray<FRTSSelectableHandle>& OutHandles
+	);
+	static void GetSelectableHandlesInViewRectOnGround(
+		const UObject* WorldContextObject,
+		const FMinimalViewInfo& ViewInfo,
+		const FIntPoint& ViewportSize,
+		const FVector2D& FirstPoint,
+		const FVector2D& SecondPoint,
+		TArray<FRTSSelectableHandle>& OutHandles
+	);
+
 	static URTSSelectorSubsystem* Get(const APlayerController* PlayerController)
 	{
 		return CastChecked<URTSSelectorSubsystem>(PlayerController->GetLocalPlayer()->GetSubsystem<URTSSelectorSubsystem>());
 	}
 protected:
 	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
 	
 private:
 	UPROPERTY()
@@ -120,17 +281,67 @@ private:
 
 	UPROPERTY()
 	TObjectPtr<ARTSHUD> HUD = nullptr;
+
+	UPROPERTY()
+	TObjectPtr<URTSSelectableRegistry> SelectableRegistry = nullptr;
+
+	UPROPERTY()
+	TObjectPtr<ARTSSelectionIndicators> SelectionIndicators = nullptr;
+
+	// Selectables unregister on EndPlay, which evicts them from these
+	FRTSSelectableHandleSet SelectedHandles;
+	FRTSSelectableHandleSet HoveredHandles;
+
+	// Units that died stay in their groups until the group is next used
+	static constexpr int32 NumControlGroups = 10;
+	FRTSSelectableHandleSet ControlGroups[NumControlGroups];
 	
 	void BindInputActions();
 	void BindInputMappingContext();
 
-	void SelectActors(const TArray<URTSSelectable*>& ActorsToSelect);
-	void DeselectActors(const TArray<URTSSelectable*>& ActorsToDeselect);
+	void ChangeSelection(TConstArrayView<FRTSSelectableHandle> HandlesToSelect, TConstArrayView<FRTSSelectableHandle> HandlesToDeselect);
+	void SetSelection(TConstArrayView<FRTSSelectableHandle> NewHandles, bool bAppend);
+	void GatherOfClassOnScreen(const UClass* Class, TArray<FRTSSelectableHandle>& OutHandles);
+	FRTSSelectableHandle FindClosestToCursor(TConstArrayView<FRTSSelectableHandle> Handles);
 	void DeselectActors();
 
-	void HoverActors(const TArray<URTSSelectable*>& ActorsToHover);
-	void UnhoverActors(const TArray<URTSSelectable*>& ActorsToUnhover);
+	void ChangeHover(TConstArrayView<FRTSSelectableHandle> HandlesToHover, TConstArrayView<FRTSSelectableHandle> HandlesToUnhover);
 	void UnhoverActors();
 
-	void GetSelectablesFromActors(const TArray<AActor*>& Actors, TArray<URTSSelectable*>& OutSelectables);
+	void GetHandlesFromActors(const TArray<AActor*>& Actors, TArray<FRTSSelectableHandle>& OutHandles) const;
+	void ResolveSelectables(const FRTSSelectableHandleSet& Handles, TArray<URTSSelectable*>& OutSelectables) const;
+	void OnSelectableUnregistered(const FRTSSelectableHandle& Handle);
+	FRTSSelectableHandleSet* GetControlGroup(int32 GroupIndex);
+
+	void FlushSelectionStateChanges();
+	void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	// Scratch buffers reused by the selection and hover paths so that dragging a box doesn't allocate every frame.
+	// Not reflected, everything in them is also referenced from the registry or the selected/hovered sets.
+	// Processing a selection from inside one of the selection delegates would clobber them, defer it instead
+	TArray<FRTSSelectableHandle> InputHandlesBuffer;
+	FRTSSelectableHandleSet InputSetBuffer;
+	TArray<FRTSSelectableHandle> SelectedBuffer;
+	TArray<FRTSSelectableHandle> DeselectedBuffer;
+	TArray<AActor*> BroadcastActorsBuffer;
+	TArray<FRTSSelectableHandle> QueryHandlesBuffer;
+	FRTSSelectionBoundsSoA QueryBoundsBuffer;
+	TArray<uint8> QueryHitsBuffer;
+
+	// Selectables whose state changed since the last flush, each added once
+	UPROPERTY()
+	TArray<TObjectPtr<URTSSelectable>> DirtySelectables;
+	TArray<TObjectPtr<URTSSelectable>> FlushingSelectables;
+	TArray<URTSSelectable*> ChangedSelectables;
+	FDelegateHandle EndFrameHandle;
+
+	// Single and group select complete on the same release in no set order, so the final selection is resolved
+	// once both have run, after the actors including the player controller have ticked
+	bool bResolveSelectionPending = false;
+	FDelegateHandle PostActorTickHandle;
+
+	FRTSScreenProjectionCache ScreenProjectionCache;
+	FRTSSelectionView ScreenProjectionView;
+	uint64 ScreenProjectionFrame = TNumericLimits<uint64>::Max();
+	bool bHasScreenProjectionView = false;
 };